@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlas.h"
+#include "trace.h"
+
+#define ATLAS_WIDTH 256
+
+/* empty pixels around every sprite, so scaled sprites don't pick up their neighbours */
+#define ATLAS_PADDING 1
+
+static void init_indices(Atlas *atlas) {
+  /* every quad is two triangles */
+  for (int i=0; i<MAX_BATCH_QUADS; i ++) {
+    int *quad = &atlas->indices[i * 6];
+    
+    quad[0] = i * 4;
+    quad[1] = i * 4 + 1;
+    quad[2] = i * 4 + 2;
+    quad[3] = i * 4 + 2;
+    quad[4] = i * 4 + 3;
+    quad[5] = i * 4;
+    }
+  }
+
+bool atlas_pack(Atlas *atlas, SDL_Surface **surfaces, int num_sprites) {
+  memset(atlas, 0, sizeof(Atlas));
+  
+  if (num_sprites > MAX_SPRITES) return false;
+  atlas->num_sprites = num_sprites;
+  
+  /* shelf packing, the tallest sprites first so every shelf wastes little height */
+  int order[MAX_SPRITES];
+  for (int i=0; i<num_sprites; i ++) {
+    int j = i;
+    for (; j > 0 && surfaces[order[j-1]]->h < surfaces[i]->h; j --) order[j] = order[j-1];
+    order[j] = i;
+    }
+  
+  int x = 0, y = 0, shelf_height = 0;
+  
+  for (int i=0; i<num_sprites; i ++) {
+    SDL_Surface *surface = surfaces[order[i]];
+    int w = surface->w + ATLAS_PADDING * 2;
+    int h = surface->h + ATLAS_PADDING * 2;
+    
+    if (w > ATLAS_WIDTH) return false;
+    
+    if (x + w > ATLAS_WIDTH) {
+      x = 0;
+      y += shelf_height;
+      shelf_height = 0;
+      }
+    
+    atlas->sprites[order[i]] = (SDL_Rect) {x + ATLAS_PADDING, y + ATLAS_PADDING, surface->w, surface->h};
+    
+    x += w;
+    if (h > shelf_height) shelf_height = h;
+    }
+  
+  atlas->surface = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, y + shelf_height, 32, SDL_PIXELFORMAT_RGBA32);
+  if (!atlas->surface) return false;
+  
+  for (int i=0; i<num_sprites; i ++) {
+    /* a plain copy, alpha included */
+    SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+    if (SDL_BlitSurface(surfaces[i], NULL, atlas->surface, &atlas->sprites[i])) return false;
+    }
+  
+  init_indices(atlas);
+  
+  return true;
+  }
+
+bool atlas_load(Atlas *atlas, void *pixels, int w, int h, const SDL_Rect *sprites, int num_sprites) {
+  memset(atlas, 0, sizeof(Atlas));
+  
+  if (num_sprites > MAX_SPRITES) return false;
+  
+  atlas->num_sprites = num_sprites;
+  memcpy(atlas->sprites, sprites, sizeof(SDL_Rect) * num_sprites);
+  
+  atlas->surface = SDL_CreateRGBSurfaceWithFormatFrom(pixels, w, h, 32, w * 4, SDL_PIXELFORMAT_RGBA32);
+  if (!atlas->surface) return false;
+  
+  init_indices(atlas);
+  
+  return true;
+  }
+
+void atlas_free(Atlas *atlas) {
+  if (atlas->texture) SDL_DestroyTexture(atlas->texture);
+  if (atlas->surface) SDL_FreeSurface(atlas->surface);
+  
+  atlas->texture = NULL;
+  atlas->surface = NULL;
+  }
+
+void atlas_draw(Atlas *atlas, SDL_Renderer *renderer, SDL_Rect source, SDL_Rect destination) {
+  if (atlas->num_quads == MAX_BATCH_QUADS) atlas_flush(atlas, renderer);
+  
+  atlas->sources[atlas->num_quads] = source;
+  atlas->destinations[atlas->num_quads] = destination;
+  atlas->num_quads ++;
+  }
+
+void atlas_draw_sprite(Atlas *atlas, SDL_Renderer *renderer, int sprite, int x, int y) {
+  SDL_Rect source = atlas->sprites[sprite];
+  atlas_draw(atlas, renderer, source, (SDL_Rect) {x, y, source.w, source.h});
+  }
+
+void atlas_flush(Atlas *atlas, SDL_Renderer *renderer) {
+  if (!atlas->num_quads) return;
+  
+  TRACE_BEGIN("atlas_flush");
+  
+  const SDL_Color white = {255, 255, 255, 255};
+  float scale_x = 1.0f / atlas->surface->w;
+  float scale_y = 1.0f / atlas->surface->h;
+  
+  for (int i=0; i<atlas->num_quads; i ++) {
+    SDL_Rect source = atlas->sources[i];
+    SDL_Rect destination = atlas->destinations[i];
+    SDL_Vertex *quad = &atlas->vertices[i * 4];
+    
+    float left = source.x * scale_x, right = (source.x + source.w) * scale_x;
+    float top = source.y * scale_y, bottom = (source.y + source.h) * scale_y;
+    
+    quad[0] = (SDL_Vertex) {{destination.x, destination.y}, white, {left, top}};
+    quad[1] = (SDL_Vertex) {{destination.x + destination.w, destination.y}, white, {right, top}};
+    quad[2] = (SDL_Vertex) {{destination.x + destination.w, destination.y + destination.h}, white, {right, bottom}};
+    quad[3] = (SDL_Vertex) {{destination.x, destination.y + destination.h}, white, {left, bottom}};
+    }
+  
+  /* renderers without geometry support get one copy per quad */
+  if (SDL_RenderGeometry(renderer, atlas->texture, atlas->vertices, atlas->num_quads * 4, atlas->indices, atlas->num_quads * 6)) {
+    for (int i=0; i<atlas->num_quads; i ++)
+      SDL_RenderCopy(renderer, atlas->texture, &atlas->sources[i], &atlas->destinations[i]);
+    }
+  
+  atlas->num_quads = 0;
+  
+  TRACE_END("atlas_flush");
+  }
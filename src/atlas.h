@@ -0,0 +1,47 @@
+/* Texture atlas
+ * every sprite packed into one texture, sprites are queued as quads and
+ * drawn in as few SDL_RenderGeometry calls as possible */
+
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <SDL2/SDL.h>
+
+#include "core.h"
+
+#define MAX_SPRITES 32
+
+/* quads queued before the batch is drawn on its own */
+#define MAX_BATCH_QUADS 256
+
+typedef struct {
+  SDL_Surface *surface; /* the packed pixels, kept so the texture can be recreated */
+  SDL_Texture *texture;
+  
+  SDL_Rect sprites[MAX_SPRITES]; /* where every sprite is in the atlas */
+  int num_sprites;
+  
+  /* the queued quads, in atlas and screen pixels */
+  SDL_Rect sources[MAX_BATCH_QUADS];
+  SDL_Rect destinations[MAX_BATCH_QUADS];
+  int num_quads;
+  
+  SDL_Vertex vertices[MAX_BATCH_QUADS * 4];
+  int indices[MAX_BATCH_QUADS * 6];
+  } Atlas;
+
+/* packs the surfaces, sprite i ends up in atlas->sprites[i]. The surfaces are
+ * only copied, a blank surface reserves space to draw into later */
+bool atlas_pack(Atlas *atlas, SDL_Surface **surfaces, int num_sprites);
+
+/* an atlas that was packed before, pixels are RGBA32 and aren't copied */
+bool atlas_load(Atlas *atlas, void *pixels, int w, int h, const SDL_Rect *sprites, int num_sprites);
+void atlas_free(Atlas *atlas);
+
+/* queues a part of the atlas, everything queued is drawn by atlas_flush.
+ * Anything drawn without the atlas has to flush it first to stay in order */
+void atlas_draw(Atlas *atlas, SDL_Renderer *renderer, SDL_Rect source, SDL_Rect destination);
+void atlas_draw_sprite(Atlas *atlas, SDL_Renderer *renderer, int sprite, int x, int y);
+void atlas_flush(Atlas *atlas, SDL_Renderer *renderer);
+
+#endif
@@ -0,0 +1,501 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "lines.h"
+#include "rules.h"
+#include "replay.h"
+
+/* ========== UTILS ========== */
+
+uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+  }
+
+void random_seed(Random *rng, uint64_t seed) {
+  /* expand the seed with splitmix64 so similar seeds give unrelated streams */
+  for (int i=0; i<4; i ++)
+    rng->s[i] = splitmix64(&seed);
+  }
+
+static inline uint64_t rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+  }
+
+uint64_t random_next(Random *rng) {
+  /* xoshiro256** */
+  uint64_t *s = rng->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  
+  return result;
+  }
+
+uint32_t random_below(Random *rng, uint32_t n) {
+  /* unbiased number in [0, n), Lemire's multiply and reject method */
+  uint64_t m = (uint64_t) (uint32_t) (random_next(rng) >> 32) * n;
+  uint32_t low = (uint32_t) m;
+  
+  if (low < n) {
+    uint32_t threshold = -n % n;
+    while (low < threshold) {
+      m = (uint64_t) (uint32_t) (random_next(rng) >> 32) * n;
+      low = (uint32_t) m;
+      }
+    }
+  
+  return m >> 32;
+  }
+
+int randint(Random *rng, int minimum_number, int max_number) {
+  return minimum_number + (int) random_below(rng, max_number + 1 - minimum_number);
+  }
+
+/* ========== SHAPES ========== */
+
+Shape shape_from_template(unsigned int template_id, unsigned int color) {
+  Shape shape = rules->shapes[template_id];
+  shape.color = color;
+  return shape;
+  }
+
+int random_template(Random *rng) {
+  return rules->spawn_table[random_below(rng, rules->total_spawn_weight)];
+  }
+
+const ShapeCell *shape_cells(const Shape *shape) {
+  /* kept with the rules, so copying a shape stays cheap */
+  return rules->cells[shape->template_id];
+  }
+
+int num_templates() {
+  return rules->num_shapes;
+  }
+
+void core_init() {
+  static bool initialized = false;
+  if (initialized) return;
+  
+  rules_init();
+  lines_init();
+  
+  initialized = true;
+  }
+
+/* ========== BITBOARDS ========== */
+
+void bitboard_clear(Bitboard *bitboard, int size) {
+  bitboard->size = size;
+  memset(bitboard->rows, 0, sizeof(bitboard->rows));
+  }
+
+void bitboard_copy(Bitboard *destination, const Bitboard *source) {
+  /* only the rows in use, the searches copy a board for every node */
+  destination->size = source->size;
+  memcpy(destination->rows, source->rows, sizeof(Row) * source->size);
+  }
+
+bool bitboard_equal(const Bitboard *a, const Bitboard *b) {
+  return a->size == b->size && !memcmp(a->rows, b->rows, sizeof(Row) * a->size);
+  }
+
+uint64_t bitboard_key(const Bitboard *bitboard) {
+  /* Boards up to 8x8 are packed into the key exactly, bit y * size + x.
+   * Bigger ones are hashed, so two of them can share a key */
+  int size = bitboard->size;
+  uint64_t key = 0;
+  
+  if (size * size <= 64) {
+    for (int y=0; y<size; y++)
+      key |= bitboard->rows[y] << (y * size);
+    
+    return key;
+    }
+  
+  for (int y=0; y<size; y++)
+    key = (rotl(key, 23) ^ bitboard->rows[y]) * 0x9E3779B97F4A7C15ull;
+  
+  return key ^ (key >> 29);
+  }
+
+int bitboard_count(const Bitboard *bitboard) {
+  int count = 0;
+  for (int y=0; y<bitboard->size; y++)
+    count += __builtin_popcountll(bitboard->rows[y]);
+  
+  return count;
+  }
+
+void bitboard_place(Bitboard *bitboard, Shape shape, int block_x, int block_y) {
+  /* no bounds or overlap checks, see fitting_columns */
+  for (int shape_y=0; shape_y<shape.height; shape_y ++)
+    bitboard->rows[block_y + shape_y] |= (Row) shape.rows[shape_y] << block_x;
+  }
+
+Row fitting_columns(const Bitboard *occupied, const Shape *shape, int block_y) {
+  /* Bit x is set when the shape fits with its top left corner at (x, block_y).
+   * Every block of the shape rules out the columns that would put it on an occupied cell,
+   * so a whole row of placements costs one shift per block */
+  int size = occupied->size;
+  
+  if (block_y < 0 || block_y + shape->height > size || shape->width > size) return 0;
+  
+  Row columns = ROW_MASK(size - shape->width + 1);
+  
+  for (int shape_y=0; shape_y<shape->height && columns; shape_y ++) {
+    Row row = occupied->rows[block_y + shape_y];
+    
+    for (unsigned int bits = shape->rows[shape_y]; bits; bits >>= 1, row >>= 1) {
+      if (bits & 1) columns &= ~row;
+      }
+    }
+  
+  return columns;
+  }
+
+void full_lines(const Bitboard *occupied, Bitboard *lines, int *num_rows, int *num_columns) {
+  /* The mask of every cell on a full line, for the searches and previews.
+   * A column is full when it's set in every row */
+  int size = occupied->size;
+  Row full_row = ROW_MASK(size);
+  bool full_rows;
+  Row full_columns = line_kernels.scan(occupied->rows, size, full_row, &full_rows);
+  
+  lines->size = size;
+  
+  for (int y=0; y<size; y++) {
+    if (occupied->rows[y] == full_row) {
+      lines->rows[y] = full_row;
+      (*num_rows) ++;
+      }
+    else
+      lines->rows[y] = full_columns;
+    }
+  
+  if (full_columns) *num_columns += __builtin_popcountll(full_columns);
+  }
+
+void clear_lines(Bitboard *occupied, int *num_rows, int *num_columns) {
+  /* same as full_lines, but takes them off the board */
+  int size = occupied->size;
+  Row full_row = ROW_MASK(size);
+  bool full_rows;
+  Row full_columns = line_kernels.scan(occupied->rows, size, full_row, &full_rows);
+  
+  if (!full_columns && !full_rows) return;
+  
+  *num_rows += line_kernels.clear(occupied->rows, size, full_row, full_columns);
+  if (full_columns) *num_columns += __builtin_popcountll(full_columns);
+  }
+
+int bitboard_play(Bitboard *next, const Bitboard *occupied, const Shape *shape, int block_x, int block_y) {
+  /* The searches' inner loop: next is occupied with the shape placed and the full
+   * lines cleared. Returns the points scored.
+   * occupied can't have full lines, so only the rows the shape went into can be full
+   * and the columns are usually ruled out after a couple of rows */
+  int size = occupied->size;
+  Row full_row = ROW_MASK(size);
+  Row full_columns = full_row;
+  bool full_rows = false;
+  
+  bitboard_copy(next, occupied);
+  
+  for (int shape_y=0; shape_y<shape->height; shape_y ++) {
+    Row *row = &next->rows[block_y + shape_y];
+    
+    *row |= (Row) shape->rows[shape_y] << block_x;
+    full_rows |= *row == full_row;
+    }
+  
+  for (int y=0; y<size && full_columns; y++)
+    full_columns &= next->rows[y];
+  
+  if (!full_columns && !full_rows) return 0;
+  
+  int cleared_x = 0, cleared_y = 0;
+  clear_lines(next, &cleared_x, &cleared_y);
+  
+  return line_score(size, cleared_x, cleared_y);
+  }
+
+/* ========== BOARD ========== */
+
+bool board_size_valid(int size) {
+  /* every shape has to fit, and a row into a word */
+  return size >= MAX_SHAPE_SIZE && size <= MAX_BOARD_SIZE;
+  }
+
+void clear_board(Board *board, int size) {
+  bitboard_clear(&board->occupied, size);
+  memset(board->colors, 0, sizeof(board->colors));
+  }
+
+void fill_cell(Board *board, int index, uint8_t color) {
+  int size = board->occupied.size;
+  
+  board->occupied.rows[index / size] |= BIT(index % size);
+  board->colors[index] = color;
+  }
+
+void get_solved(Board *board, bool *rows, bool *columns) {
+  int size = board->occupied.size;
+  Row full_row = ROW_MASK(size);
+  bool full_rows;
+  Row full_columns = line_kernels.scan(board->occupied.rows, size, full_row, &full_rows);
+  
+  for (int row=0; row<size && full_rows; row++) {
+    if (board->occupied.rows[row] == full_row) rows[row] = true;
+    }
+  
+  for (int column=0; column<size; column++) {
+    if (full_columns & BIT(column)) columns[column] = true;
+    }
+  }
+
+void clear_solved(Board *board, int *cleared_x, int *cleared_y) {
+  /* the colors only count where the occupied bit is set, so they can stay */
+  clear_lines(&board->occupied, cleared_x, cleared_y);
+  }
+
+int line_score(int size, int cleared_x, int cleared_y) {
+  int score_x = cleared_x * size * rules->line_points;
+  int score_y = cleared_y * size * rules->line_points;
+  
+  return score_x + score_y + (score_x * score_y * rules->cross_bonus / 100);
+  }
+
+bool can_place_shape(Board *board, Shape shape, int block_x, int block_y) {
+  int size = board->occupied.size;
+  
+  if (block_x < 0 || block_y < 0 || block_x + shape.width > size || block_y + shape.height > size)
+    return false;
+  
+  for (int shape_y=0; shape_y<shape.height; shape_y ++) {
+    if (board->occupied.rows[block_y + shape_y] & ((Row) shape.rows[shape_y] << block_x)) return false;
+    }
+  
+  return true;
+  }
+
+static bool shape_fits(const Bitboard *occupied, Shape shape) {
+  for (int block_y=0; block_y + shape.height <= occupied->size; block_y ++) {
+    if (fitting_columns(occupied, &shape, block_y)) return true;
+    }
+  
+  return false;
+  }
+
+bool template_fits(const Bitboard *occupied, int template_id) {
+  return shape_fits(occupied, rules->shapes[template_id]);
+  }
+
+bool can_place_shape_anywhere(Board *board, Shape shape) {
+  return shape_fits(&board->occupied, shape);
+  }
+
+bool place_shape(Board *board, Shape shape, int block_x, int block_y) {
+  /* Check if the shape can be placed */
+  if (!can_place_shape(board, shape, block_x, block_y)) return false;
+  
+  int size = board->occupied.size;
+  
+  for (int shape_y=0; shape_y<shape.height; shape_y ++) {
+    int y = block_y + shape_y;
+    Row placed = (Row) shape.rows[shape_y] << block_x;
+    int x;
+    
+    board->occupied.rows[y] |= placed;
+    FOR_EACH_BIT(x, placed)
+      board->colors[y * size + x] = (uint8_t) shape.color;
+    }
+  
+  return true;
+  }
+
+/* ========== GAME ========== */
+
+static bool fits_in_some_order(const Bitboard *occupied, Shape *selection, uint8_t remaining, long *budget) {
+  /* a search that ran out of nodes proved nothing, it unwinds from here */
+  if (-- *budget < 0) return false;
+  
+  for (int i=0; i<SELECTION_SIZE; i ++) {
+    if (!(remaining & (1 << i))) continue;
+    
+    /* identical pieces are interchangeable, only try the first one */
+    bool duplicate = false;
+    for (int j=0; j<i; j ++) {
+      if ((remaining & (1 << j)) && selection[j].template_id == selection[i].template_id) duplicate = true;
+      }
+    if (duplicate) continue;
+    
+    uint8_t rest = remaining & ~(1 << i);
+    Shape shape = selection[i];
+    
+    for (int block_y=0; block_y + shape.height <= occupied->size; block_y ++) {
+      Row columns = fitting_columns(occupied, &shape, block_y);
+      int block_x;
+      
+      if (columns && !rest) return true;
+      
+      FOR_EACH_BIT(block_x, columns) {
+        Bitboard next;
+        bitboard_play(&next, occupied, &shape, block_x, block_y);
+        
+        if (fits_in_some_order(&next, selection, rest, budget)) return true;
+        }
+      }
+    }
+  
+  return false;
+  }
+
+static bool fits_within_budget(Board *board, Shape *selection, bool *unproven) {
+  uint8_t remaining = 0;
+  for (int i=0; i<SELECTION_SIZE; i ++) {
+    if (selection[i].color) remaining |= 1 << i;
+    }
+  
+  int size = board->occupied.size;
+  long budget = (long) MAX_DEAL_NODES * ((size + 7) / 8);
+  
+  bool fits = !remaining || fits_in_some_order(&board->occupied, selection, remaining, &budget);
+  *unproven = !fits && budget < 0;
+  return fits;
+  }
+
+bool selection_fits(Board *board, Shape *selection) {
+  /* true when every piece left in the selection can be placed in at least one order,
+   * false when it can't or that wasn't found within the budget */
+  bool unproven;
+  return fits_within_budget(board, selection, &unproven);
+  }
+
+void generate_selection(Game *game) {
+  /* Generate selection, in fair deal mode redraw until all of it fits.
+   * Gives up after MAX_DEAL_ATTEMPTS so a full board still ends the game,
+   * a deal the search ran out on is still better than one that can't fit */
+  Shape unproven_selection[SELECTION_SIZE];
+  bool has_unproven = false;
+  
+  for (int attempt=0; attempt<MAX_DEAL_ATTEMPTS; attempt ++) {
+    for (int i=0; i<SELECTION_SIZE; i ++) {
+      game->selection[i] = shape_from_template(random_template(&game->rng), randint(&game->rng, 1, NUM_COLORS-1));
+      }
+    
+    if (!game->fair_deal) break;
+    
+    bool unproven;
+    if (fits_within_budget(&game->board, game->selection, &unproven)) break;
+    
+    if (unproven && !has_unproven) {
+      memcpy(unproven_selection, game->selection, sizeof(unproven_selection));
+      has_unproven = true;
+      }
+    
+    if (attempt == MAX_DEAL_ATTEMPTS - 1 && has_unproven) {
+      memcpy(game->selection, unproven_selection, sizeof(unproven_selection));
+      game->unproven_deals ++;
+      }
+    }
+  
+  if (game->recorder) record_deal(game->recorder, game->selection);
+  }
+
+void new_game(Game *game, uint64_t seed) {
+  random_seed(&game->rng, seed);
+  game->unproven_deals = 0;
+  
+  clear_board(&game->board, game->board_size ? game->board_size : rules->board_size);
+  if (game->recorder) record_game(game->recorder, seed, game);
+  
+  generate_selection(game);
+  
+  game->score = 0;
+  game->over = false;
+  }
+
+int legal_moves(Game *game, Move *moves) {
+  int num_moves = 0;
+  
+  for (int i=0; i<SELECTION_SIZE; i ++) {
+    Shape shape = game->selection[i];
+    if (!shape.color) continue;
+    
+    for (int block_y=0; block_y + shape.height <= game->board.occupied.size; block_y ++) {
+      int block_x;
+      
+      FOR_EACH_BIT(block_x, fitting_columns(&game->board.occupied, &shape, block_y))
+        moves[num_moves ++] = (Move) {i, block_x, block_y};
+      }
+    }
+  
+  return num_moves;
+  }
+
+bool apply_move(Game *game, Move move) {
+  if (game->over || move.shape >= SELECTION_SIZE) return false;
+  
+  Shape shape = game->selection[move.shape];
+  if (!shape.color) return false;
+  
+  if (!place_shape(&game->board, shape, move.x, move.y)) return false;
+  if (game->recorder) record_move(game->recorder, move);
+  
+  int cleared_x = 0;
+  int cleared_y = 0;
+  clear_solved(&game->board, &cleared_x, &cleared_y);
+  
+  game->score += line_score(game->board.occupied.size, cleared_x, cleared_y);
+  game->selection[move.shape].color = 0;
+  
+  /* Regenerate the selection when all the blocks are used up */
+  {
+    bool do_generate = true;
+    
+    for (int i=0; i<SELECTION_SIZE; i ++) {
+      if (game->selection[i].color) {
+        do_generate = false;
+        break;
+        }
+      }
+    
+    if (do_generate)
+      generate_selection(game);
+    }
+  
+  /* Check if the game should be over */
+  bool can_place_anything = false;
+  for (int i=0; i<SELECTION_SIZE; i++) {
+    Shape shape = game->selection[i];
+    
+    if (!shape.color) continue;
+    if (can_place_shape_anywhere(&game->board, shape)) {
+      can_place_anything = true;
+      break;
+      }
+    }
+  
+  game->over = !can_place_anything;
+  if (game->over && game->recorder) record_end(game->recorder, game->score);
+  
+  return true;
+  }
+
+bool is_over(Game *game) {
+  return game->over;
+  }
+
+int score(Game *game) {
+  return game->score;
+  }
@@ -0,0 +1,155 @@
+/* Game core
+ * all of the game rules, without any SDL so it can run headless */
+
+#ifndef CORE_H
+#define CORE_H
+
+#include <stdint.h>
+
+typedef unsigned char bool;
+#define true 1
+#define false 0
+
+/* the board size is picked at runtime, a row has to fit into one 64 bit word */
+#define DEFAULT_BOARD_SIZE 8
+#define MAX_BOARD_SIZE 64
+
+#define SELECTION_SIZE 3
+
+/* color 0 is reserved for highlighting, shapes use 1 .. NUM_COLORS-1 */
+#define NUM_COLORS 4
+
+/* Shapes */
+
+#define MAX_SHAPE_SIZE 5
+#define MAX_SHAPE_CELLS (MAX_SHAPE_SIZE * MAX_SHAPE_SIZE)
+
+typedef struct {
+  uint8_t x, y;
+  } ShapeCell;
+
+typedef struct {
+  unsigned int width;
+  unsigned int height;
+  unsigned int color;
+  unsigned int template_id; /* every orientation has its own, equal ids mean identical shapes */
+  uint8_t rows[MAX_SHAPE_SIZE]; /* bit x of rows[y] is set for the block at (x, y) */
+
+  int num_cells; /* the blocks as a list are in shape_cells */
+  } Shape;
+
+/* Bitboards
+ * one word per row, bit x of rows[y] is set when the cell at (x, y) is occupied.
+ * Everything works a whole row at a time, so it scales with the rows and not the cells */
+
+typedef uint64_t Row;
+
+typedef struct {
+  int size;
+  Row rows[MAX_BOARD_SIZE]; /* only the first size are used */
+  } Bitboard;
+
+typedef struct {
+  Bitboard occupied;
+  uint8_t colors[MAX_BOARD_SIZE * MAX_BOARD_SIZE]; /* y * size + x, only valid where the occupied bit is set */
+  } Board;
+
+#define BIT(x) ((Row) 1 << (x))
+
+/* the bits a row of the board uses */
+#define ROW_MASK(size) (~(Row) 0 >> (64 - (size)))
+
+#define IS_OCCUPIED(bitboard, x, y) (((bitboard)->rows[y] >> (x)) & 1)
+
+#define FOR_EACH_BIT(index, row) \
+  for (Row _bits = (row); _bits && ((index) = __builtin_ctzll(_bits), 1); _bits &= _bits - 1)
+
+/* Random numbers
+ * every game carries its own generator, so games are reproducible from
+ * their seed and can run in parallel */
+
+typedef struct {
+  uint64_t s[4];
+  } Random;
+
+/* Game */
+
+typedef struct {
+  uint8_t shape; /* index into the selection */
+  uint8_t x;
+  uint8_t y;
+  } Move;
+
+#define MAX_MOVES (SELECTION_SIZE * MAX_BOARD_SIZE * MAX_BOARD_SIZE)
+
+#define MAX_DEAL_ATTEMPTS 100
+
+/* boards a fair deal searches per 8 cells of board side to prove a selection fits.
+ * if no attempt is proven, the first unproven one is dealt and counted in unproven_deals */
+#define MAX_DEAL_NODES 4096
+
+struct Recorder;
+
+typedef struct {
+  Board board;
+  Shape selection[SELECTION_SIZE]; /* used up shapes have color 0 */
+  int score;
+  bool over;
+  int unproven_deals; /* fair deals that went out without being proven to fit */
+
+  /* settings, not reset by new_game */
+  bool fair_deal; /* only deal selections that can be placed completely, see MAX_DEAL_NODES */
+  int board_size; /* the ruleset's when 0 */
+  struct Recorder *recorder; /* every deal and move is recorded into it when set, see replay.h */
+
+  Random rng;
+  } Game;
+
+void core_init();
+
+void random_seed(Random *rng, uint64_t seed);
+uint64_t random_next(Random *rng);
+uint32_t random_below(Random *rng, uint32_t n);
+int randint(Random *rng, int minimum_number, int max_number);
+
+/* bitboards */
+void bitboard_clear(Bitboard *bitboard, int size);
+void bitboard_copy(Bitboard *destination, const Bitboard *source);
+bool bitboard_equal(const Bitboard *a, const Bitboard *b);
+uint64_t bitboard_key(const Bitboard *bitboard);
+int bitboard_count(const Bitboard *bitboard);
+
+void bitboard_place(Bitboard *bitboard, Shape shape, int block_x, int block_y);
+Row fitting_columns(const Bitboard *occupied, const Shape *shape, int block_y);
+void full_lines(const Bitboard *occupied, Bitboard *lines, int *num_rows, int *num_columns);
+void clear_lines(Bitboard *occupied, int *num_rows, int *num_columns);
+int bitboard_play(Bitboard *next, const Bitboard *occupied, const Shape *shape, int block_x, int block_y);
+
+/* board */
+bool board_size_valid(int size);
+void clear_board(Board *board, int size);
+void fill_cell(Board *board, int index, uint8_t color);
+void get_solved(Board *board, bool *rows, bool *columns);
+void clear_solved(Board *board, int *cleared_x, int *cleared_y);
+int line_score(int size, int cleared_x, int cleared_y);
+
+bool can_place_shape(Board *board, Shape shape, int block_x, int block_y);
+bool can_place_shape_anywhere(Board *board, Shape shape);
+bool template_fits(const Bitboard *occupied, int template_id);
+bool place_shape(Board *board, Shape shape, int block_x, int block_y);
+
+Shape shape_from_template(unsigned int template_id, unsigned int color);
+int num_templates();
+int random_template(Random *rng);
+const ShapeCell *shape_cells(const Shape *shape);
+
+/* step api */
+void new_game(Game *game, uint64_t seed);
+void generate_selection(Game *game);
+bool selection_fits(Board *board, Shape *selection);
+int legal_moves(Game *game, Move *moves);
+bool apply_move(Game *game, Move move);
+bool is_over(Game *game);
+int score(Game *game);
+
+#endif
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hint.h"
+#include "trace.h"
+
+/* The worker's search is capped so big boards still get a hint within a second
+ * or two, the best line so far is shown then. 8x8 boards stay well under it */
+#define HINT_MAX_NODES 4000000
+
+/* without a worker the search runs in the frame, this keeps it to a couple of milliseconds */
+#define HINT_INLINE_NODES 16000
+
+static bool hint_should_stop(void *data) {
+  HintEngine *hint = data;
+  return SDL_AtomicGet(&hint->request) != hint->searching;
+  }
+
+static void hint_publish(HintEngine *hint, int request, Solution *solution) {
+  /* seqlock write, there is only ever one writer */
+  SDL_AtomicAdd(&hint->sequence, 1);
+  SDL_MemoryBarrierRelease();
+  
+  hint->solved_request = request;
+  hint->solution = *solution;
+  
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicAdd(&hint->sequence, 1);
+  }
+
+static void hint_solve(HintEngine *hint, int request, Board *board, Shape *selection) {
+  Solution solution;
+  
+  hint->searching = request;
+  
+  TRACE_BEGIN("hint_solve");
+  solve(hint->solver, board, selection, &solution);
+  TRACE_END("hint_solve");
+  
+  if (!hint->solver->stopped)
+    hint_publish(hint, request, &solution);
+  }
+
+static int hint_worker(void *data) {
+  HintEngine *hint = data;
+  int handled = 0;
+  
+  Board board;
+  Shape selection[SELECTION_SIZE];
+  
+  SDL_LockMutex(hint->mutex);
+  
+  while (1) {
+    while (!hint->quit && SDL_AtomicGet(&hint->request) == handled)
+      SDL_CondWait(hint->wake, hint->mutex);
+    
+    if (hint->quit) break;
+    
+    handled = SDL_AtomicGet(&hint->request);
+    board = hint->board;
+    memcpy(selection, hint->selection, sizeof(selection));
+    
+    SDL_UnlockMutex(hint->mutex);
+    hint_solve(hint, handled, &board, selection);
+    SDL_LockMutex(hint->mutex);
+    }
+  
+  SDL_UnlockMutex(hint->mutex);
+  
+  return 0;
+  }
+
+HintEngine *hint_create() {
+  HintEngine *hint = calloc(1, sizeof(HintEngine));
+  
+  hint->solver = solver_create(OBJECTIVE_HEURISTIC);
+  hint->solver->should_stop = hint_should_stop;
+  hint->solver->stop_data = hint;
+  
+  hint->mutex = SDL_CreateMutex();
+  hint->wake = SDL_CreateCond();
+  
+  hint->thread = SDL_CreateThread(hint_worker, "hint", hint);
+  hint->solver->max_nodes = hint->thread ? HINT_MAX_NODES : HINT_INLINE_NODES;
+  
+  if (!hint->thread) printf("hint: no worker thread (%s), solving inline with a small budget\n", SDL_GetError());
+  
+  return hint;
+  }
+
+void hint_destroy(HintEngine *hint) {
+  if (hint->thread) {
+    SDL_LockMutex(hint->mutex);
+    hint->quit = true;
+    SDL_AtomicAdd(&hint->request, 1); /* stops a running search */
+    SDL_CondSignal(hint->wake);
+    SDL_UnlockMutex(hint->mutex);
+    
+    SDL_WaitThread(hint->thread, NULL);
+    }
+  
+  SDL_DestroyCond(hint->wake);
+  SDL_DestroyMutex(hint->mutex);
+  solver_destroy(hint->solver);
+  free(hint);
+  }
+
+static bool same_position(HintEngine *hint, Board *board, Shape *selection) {
+  if (!hint->has_position || !bitboard_equal(&hint->last_occupied, &board->occupied)) return false;
+  
+  for (int i=0; i<SELECTION_SIZE; i ++) {
+    if (hint->last_selection[i].template_id != selection[i].template_id) return false;
+    if (!hint->last_selection[i].color != !selection[i].color) return false;
+    }
+  
+  return true;
+  }
+
+void hint_request(HintEngine *hint, Board *board, Shape *selection) {
+  if (same_position(hint, board, selection)) return;
+  
+  hint->has_position = true;
+  bitboard_copy(&hint->last_occupied, &board->occupied);
+  memcpy(hint->last_selection, selection, sizeof(hint->last_selection));
+  
+  SDL_LockMutex(hint->mutex);
+  
+  hint->board = *board;
+  memcpy(hint->selection, selection, sizeof(hint->selection));
+  int request = SDL_AtomicAdd(&hint->request, 1) + 1;
+  
+  SDL_CondSignal(hint->wake);
+  SDL_UnlockMutex(hint->mutex);
+  
+  if (!hint->thread)
+    hint_solve(hint, request, board, selection);
+  }
+
+bool hint_get(HintEngine *hint, Solution *solution) {
+  int request = SDL_AtomicGet(&hint->request);
+  int sequence, solved_request;
+  
+  /* seqlock read, never waits on the worker */
+  do {
+    sequence = SDL_AtomicGet(&hint->sequence);
+    if (sequence & 1) return false;
+    
+    SDL_MemoryBarrierAcquire();
+    solved_request = hint->solved_request;
+    *solution = hint->solution;
+    SDL_MemoryBarrierAcquire();
+    } while (SDL_AtomicGet(&hint->sequence) != sequence);
+  
+  return solved_request == request;
+  }
@@ -0,0 +1,50 @@
+/* Hint engine
+ * runs the solver on a background thread so the search never stalls a frame */
+
+#ifndef HINT_H
+#define HINT_H
+
+#include <SDL2/SDL.h>
+
+#include "core.h"
+#include "solver.h"
+
+typedef struct {
+  SDL_Thread *thread; /* NULL when threads aren't available, then hints are solved inline within HINT_INLINE_NODES */
+  SDL_mutex *mutex;
+  SDL_cond *wake;
+  bool quit;
+  
+  Solver *solver;
+  int searching; /* the request the worker is solving, only touched by the worker */
+  
+  /* the last position requested, only touched by the main thread */
+  bool has_position;
+  Bitboard last_occupied;
+  Shape last_selection[SELECTION_SIZE];
+  
+  /* the position to solve, guarded by mutex */
+  Board board;
+  Shape selection[SELECTION_SIZE];
+  
+  /* bumped for every new position, a search for an older one stops itself */
+  SDL_atomic_t request;
+  
+  /* the published result, written by the worker and read without locking:
+   * sequence is odd while the worker is writing */
+  SDL_atomic_t sequence;
+  int solved_request;
+  Solution solution;
+  } HintEngine;
+
+HintEngine *hint_create();
+void hint_destroy(HintEngine *hint);
+
+/* cheap to call every frame, only starts a new search when the position changed */
+void hint_request(HintEngine *hint, Board *board, Shape *selection);
+
+/* returns false while the current position is still being searched,
+ * solution->num_moves is 0 when none of the pieces fit */
+bool hint_get(HintEngine *hint, Solution *solution);
+
+#endif
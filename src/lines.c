@@ -0,0 +1,237 @@
+#include <string.h>
+
+#include "lines.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LINES_X86
+#endif
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define LINES_WASM
+#endif
+
+/* ========== SCALAR ========== */
+
+static Row scan_scalar(const Row *rows, int size, Row full_row, bool *full_rows) {
+  Row full_columns = full_row;
+  bool any_full = false;
+  
+  for (int y=0; y<size; y++) {
+    full_columns &= rows[y];
+    any_full |= rows[y] == full_row;
+    }
+  
+  *full_rows = any_full;
+  return full_columns;
+  }
+
+static int clear_scalar(Row *rows, int size, Row full_row, Row full_columns) {
+  int num_rows = 0;
+  
+  for (int y=0; y<size; y++) {
+    if (rows[y] == full_row) {
+      rows[y] = 0;
+      num_rows ++;
+      }
+    else
+      rows[y] &= ~full_columns;
+    }
+  
+  return num_rows;
+  }
+
+/* ========== SSE2 ========== */
+
+#ifdef LINES_X86
+
+/* SSE2 has no 64 bit compare, both 32 bit halves have to match */
+static inline __m128i equal_64_sse2(__m128i a, __m128i b) {
+  __m128i equal = _mm_cmpeq_epi32(a, b);
+  return _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+  }
+
+static Row scan_sse2(const Row *rows, int size, Row full_row, bool *full_rows) {
+  __m128i full = _mm_set1_epi64x(full_row);
+  __m128i columns = full;
+  __m128i any_full = _mm_setzero_si128();
+  int y = 0;
+  
+  for (; y + 2 <= size; y += 2) {
+    __m128i row = _mm_loadu_si128((const __m128i *) &rows[y]);
+    
+    columns = _mm_and_si128(columns, row);
+    any_full = _mm_or_si128(any_full, equal_64_sse2(row, full));
+    }
+  
+  Row full_columns = (Row) _mm_cvtsi128_si64(columns) & (Row) _mm_cvtsi128_si64(_mm_unpackhi_epi64(columns, columns));
+  bool tail_full = false;
+  
+  full_columns &= scan_scalar(rows + y, size - y, full_row, &tail_full);
+  
+  *full_rows = _mm_movemask_epi8(any_full) || tail_full;
+  return full_columns;
+  }
+
+static int clear_sse2(Row *rows, int size, Row full_row, Row full_columns) {
+  __m128i full = _mm_set1_epi64x(full_row);
+  __m128i columns = _mm_set1_epi64x(full_columns);
+  int num_rows = 0;
+  int y = 0;
+  
+  for (; y + 2 <= size; y += 2) {
+    __m128i row = _mm_loadu_si128((const __m128i *) &rows[y]);
+    __m128i equal = equal_64_sse2(row, full);
+    
+    /* a full row is cleared completely, the others only lose the columns */
+    _mm_storeu_si128((__m128i *) &rows[y], _mm_andnot_si128(equal, _mm_andnot_si128(columns, row)));
+    num_rows += __builtin_popcount(_mm_movemask_epi8(equal)) / 8;
+    }
+  
+  return num_rows + clear_scalar(rows + y, size - y, full_row, full_columns);
+  }
+
+/* ========== AVX2 ========== */
+
+__attribute__((target("avx2")))
+static Row scan_avx2(const Row *rows, int size, Row full_row, bool *full_rows) {
+  __m256i full = _mm256_set1_epi64x(full_row);
+  __m256i columns = full;
+  __m256i any_full = _mm256_setzero_si256();
+  int y = 0;
+  
+  for (; y + 4 <= size; y += 4) {
+    __m256i row = _mm256_loadu_si256((const __m256i *) &rows[y]);
+    
+    columns = _mm256_and_si256(columns, row);
+    any_full = _mm256_or_si256(any_full, _mm256_cmpeq_epi64(row, full));
+    }
+  
+  __m128i half = _mm_and_si128(_mm256_castsi256_si128(columns), _mm256_extracti128_si256(columns, 1));
+  Row full_columns = (Row) _mm_cvtsi128_si64(half) & (Row) _mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half));
+  bool tail_full = false;
+  
+  full_columns &= scan_scalar(rows + y, size - y, full_row, &tail_full);
+  
+  *full_rows = !_mm256_testz_si256(any_full, any_full) || tail_full;
+  return full_columns;
+  }
+
+__attribute__((target("avx2")))
+static int clear_avx2(Row *rows, int size, Row full_row, Row full_columns) {
+  __m256i full = _mm256_set1_epi64x(full_row);
+  __m256i columns = _mm256_set1_epi64x(full_columns);
+  int num_rows = 0;
+  int y = 0;
+  
+  for (; y + 4 <= size; y += 4) {
+    __m256i row = _mm256_loadu_si256((const __m256i *) &rows[y]);
+    __m256i equal = _mm256_cmpeq_epi64(row, full);
+    
+    _mm256_storeu_si256((__m256i *) &rows[y], _mm256_andnot_si256(equal, _mm256_andnot_si256(columns, row)));
+    num_rows += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(equal)));
+    }
+  
+  return num_rows + clear_scalar(rows + y, size - y, full_row, full_columns);
+  }
+
+#endif
+
+/* ========== WASM SIMD128 ========== */
+
+#ifdef LINES_WASM
+
+static Row scan_wasm(const Row *rows, int size, Row full_row, bool *full_rows) {
+  v128_t full = wasm_i64x2_splat(full_row);
+  v128_t columns = full;
+  v128_t any_full = wasm_i64x2_splat(0);
+  int y = 0;
+  
+  for (; y + 2 <= size; y += 2) {
+    v128_t row = wasm_v128_load(&rows[y]);
+    
+    columns = wasm_v128_and(columns, row);
+    any_full = wasm_v128_or(any_full, wasm_i64x2_eq(row, full));
+    }
+  
+  Row full_columns = (Row) wasm_i64x2_extract_lane(columns, 0) & (Row) wasm_i64x2_extract_lane(columns, 1);
+  bool tail_full = false;
+  
+  full_columns &= scan_scalar(rows + y, size - y, full_row, &tail_full);
+  
+  *full_rows = wasm_v128_any_true(any_full) || tail_full;
+  return full_columns;
+  }
+
+static int clear_wasm(Row *rows, int size, Row full_row, Row full_columns) {
+  v128_t full = wasm_i64x2_splat(full_row);
+  v128_t columns = wasm_i64x2_splat(full_columns);
+  int num_rows = 0;
+  int y = 0;
+  
+  for (; y + 2 <= size; y += 2) {
+    v128_t row = wasm_v128_load(&rows[y]);
+    v128_t equal = wasm_i64x2_eq(row, full);
+    
+    wasm_v128_store(&rows[y], wasm_v128_andnot(wasm_v128_andnot(row, columns), equal));
+    num_rows += __builtin_popcount(wasm_i64x2_bitmask(equal));
+    }
+  
+  return num_rows + clear_scalar(rows + y, size - y, full_row, full_columns);
+  }
+
+#endif
+
+/* ========== DISPATCH ========== */
+
+/* fastest first. SSE2 pays for the emulated 64 bit compare and only beats
+ * the scalar loop on the biggest boards, so it's only picked with lines_use */
+static const LineKernels kernels[] = {
+  #ifdef LINES_X86
+  {"avx2", scan_avx2, clear_avx2},
+  #endif
+  #ifdef LINES_WASM
+  {"simd128", scan_wasm, clear_wasm},
+  #endif
+  {"scalar", scan_scalar, clear_scalar},
+  #ifdef LINES_X86
+  {"sse2", scan_sse2, clear_sse2},
+  #endif
+  };
+
+#define NUM_KERNELS ((int) (sizeof(kernels) / sizeof(kernels[0])))
+
+LineKernels line_kernels = {"scalar", scan_scalar, clear_scalar};
+
+static bool supported(const LineKernels *candidate) {
+  #ifdef LINES_X86
+  if (!strcmp(candidate->name, "avx2")) return __builtin_cpu_supports("avx2") != 0;
+  #endif
+  
+  return true;
+  }
+
+void lines_init() {
+  #ifdef LINES_X86
+  __builtin_cpu_init();
+  #endif
+  
+  for (int i=0; i<NUM_KERNELS; i ++) {
+    if (supported(&kernels[i])) {
+      line_kernels = kernels[i];
+      return;
+      }
+    }
+  }
+
+bool lines_use(const char *name) {
+  for (int i=0; i<NUM_KERNELS; i ++) {
+    if (!strcmp(kernels[i].name, name) && supported(&kernels[i])) {
+      line_kernels = kernels[i];
+      return true;
+      }
+    }
+  
+  return false;
+  }
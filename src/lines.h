@@ -0,0 +1,31 @@
+/* Line kernels
+ * finding and clearing the full lines of a board, a pass over every row word
+ * after every move. The vector versions handle 2 or 4 rows an instruction,
+ * on x86 they're picked at runtime and on the web when it's compiled with SIMD */
+
+#ifndef LINES_H
+#define LINES_H
+
+#include "core.h"
+
+typedef struct {
+  const char *name;
+  
+  /* ANDs all the rows together, the bits left are the full columns.
+   * full_rows is set when any row equals full_row */
+  Row (*scan)(const Row *rows, int size, Row full_row, bool *full_rows);
+  
+  /* rows equal to full_row become empty and every other row loses the full columns,
+   * returns the number of full rows */
+  int (*clear)(Row *rows, int size, Row full_row, Row full_columns);
+  } LineKernels;
+
+extern LineKernels line_kernels;
+
+/* picks the fastest kernels this CPU has, called by core_init */
+void lines_init();
+
+/* switches to the kernels called name, for comparing them. False when this build or CPU doesn't have them */
+bool lines_use(const char *name);
+
+#endif
@@ -1,15 +1,24 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <time.h>
+#include <string.h>
 
 #include <SDL2/SDL.h>
-#include <SDL2/SDL_image.h>
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #endif
 
-#include "shapes.h"
+#include "core.h"
+#include "rules.h"
+#include "replay.h"
+#include "atlas.h"
+#include "hint.h"
+#include "profile.h"
+#include "sprites.h"
+#include "trace.h"
+
+/* the packed atlas, generated from res/ by pack_res */
+#include "assets.h"
 
 /* ========== UTILS ========== */
 
@@ -17,16 +26,6 @@ void handle_sdl_error() {
   printf("SDL ERROR: %s\n", SDL_GetError());
   }
 
-int randint(int minimum_number, int max_number) {
-  return rand() % (max_number + 1 - minimum_number) + minimum_number;
-  }
-
-void Blit(SDL_Renderer *renderer, SDL_Texture *texture, int x, int y) {
-  int w, h;
-  if (SDL_QueryTexture(texture, NULL, NULL, &w, &h)) handle_sdl_error();
-  if (SDL_RenderCopy(renderer, texture, NULL, &(SDL_Rect) {x, y, w, h})) handle_sdl_error();
-  }
-
 int clampi(int v, int mi, int mx) {
   if (v < mi) return mi;
   if (v > mx) return mx;
@@ -44,14 +43,17 @@ SDL_Color AdjustColorBrightness(SDL_Color color, int f) {
 
 #define ASSERT(x, msg) do {if (!(x)) {printf("(%s:%d) assertion %s failed: %s\n", __FILE__, __LINE__, #x, msg);}} while (0)
 
-typedef unsigned char bool;
-#define true 1
-#define false 0
-
 /* ========== MAIN ========== */
 
 #define FPS 60
 
+/* SDL_Delay can oversleep, the frame limiter sleeps until this close to the
+ * next frame and spins the rest */
+#define FRAME_SPIN_MS 1
+
+/* an idle frame waits this long for an event before polling anyway */
+#define IDLE_TIMEOUT_MS 1000
+
 /* indexing macros */
 
 #define WIDTH  0
@@ -60,25 +62,6 @@ typedef unsigned char bool;
 #define X 0
 #define Y 1
 
-/* texture constants */
-#define NUM_TEXTURES 16
-
-#define TEXTURE_BLOCK            0
-#define TEXTURE_BLOCK_EMPTY      1
-#define TEXTURE_RESTART          2
-#define TEXTURE_7SEGMENT_0       3
-#define TEXTURE_7SEGMENT_1       4
-#define TEXTURE_7SEGMENT_2       5
-#define TEXTURE_7SEGMENT_3       6
-#define TEXTURE_7SEGMENT_4       7
-#define TEXTURE_7SEGMENT_5       8
-#define TEXTURE_7SEGMENT_6       9
-#define TEXTURE_7SEGMENT_7       10
-#define TEXTURE_7SEGMENT_8       11
-#define TEXTURE_7SEGMENT_9       12
-#define TEXTURE_7SEGMENT_BG      13
-#define TEXTURE_7SEGMENT_MINUS   14
-
 /* ... */
 const uint8_t block_texture_colors[] = {
   253, /* TOP */
@@ -92,35 +75,86 @@ const uint8_t block_texture_colors[] = {
 #define BLOCK_TEXTURE_SIDE_PX 6
 
 #define BLOCK_ALPHA_MOD 72
-#define BLOCK_SIZE_PX 32
 
-#define BOARD_SIZE 8
-#define SELECTION_SIZE 3
+/* how much brighter things get under the mouse */
+#define HOVER_BRIGHTNESS 35
+
+/* big boards get smaller cells so they still fit on the screen */
+#define MAX_BOARD_PX 512
 
 #define NOT_DRAGGING -1
 #define MOUSE_DRAG_PADDING 20
 
-Shape shape_from_template(unsigned int template_id, unsigned int color) {
-  Shape template = shape_templates[template_id];
-  return (Shape) {template.width, template.height, color, template.data};
-  }
+#define SELECTION_PADDING 10
+
+/* above the board for the score and the restart button, and below the selection */
+#define BOARD_TOP_PX 100
+#define TRAY_BOTTOM_PX 20
+
+/* the selection is drawn at BLOCK_SIZE_PX for shapes up to this wide like the built in ones,
+ * only rules with wider shapes make it smaller */
+#define TRAY_SHAPE_CELLS 4
+
+/* a playing replay shows a move this often */
+#define REPLAY_MOVE_MS 400
+
+/* what a board cell shows, a color index (0 when highlighted) or one of these */
+#define CELL_EMPTY   NUM_COLORS
+#define CELL_UNKNOWN 0xff
 
 /* Colors */
 
-const SDL_Color colors[] = {
+const SDL_Color colors[NUM_COLORS] = {
   (SDL_Color) {255, 255, 255, 255}, /* used for highliting */
   (SDL_Color) {255, 53, 53, 255},
   (SDL_Color) {72, 153, 94, 255},
   (SDL_Color) {62, 92, 169, 255},
   };
 
-const int NUM_COLORS = sizeof(colors) / sizeof(colors[0]);
-
 /* ... */
 
+/* every look of a button (size, icon, color, hover) is composed into its own texture once,
+ * the one drawn least recently makes room when they're all taken */
+#define MAX_BUTTON_TEXTURES 16
+
+typedef struct {
+  int w, h;
+  int texture_id;
+  int color_id;
+  bool hovered;
+  SDL_Texture *texture;
+  unsigned last_used; /* button_clock when it was last drawn */
+  } ButtonTexture;
+
+/* 7 segment displays are drawn into their own texture, which only changes with the value */
+#define SEGMENT_SPACING_PX 22
+
+typedef struct {
+  int digits;
+  
+  SDL_Texture *texture; /* NULL until the first draw or when it can't be rendered to */
+  int value;            /* what the texture shows, only valid with valid */
+  bool valid;
+  } Readout;
+
+/* what dropping the dragged shape where it is would do, only worked out again
+ * when the shape, the cell it snaps to or the board changes */
+typedef struct {
+  bool valid;
+  
+  int shape; /* the key */
+  int block_x, block_y;
+  unsigned board_version;
+  
+  bool can_place;
+  Bitboard placed; /* the cells the shape would cover */
+  Bitboard lines;  /* the cells of every line it would complete */
+  } DragPreview;
+
 typedef enum {
   GAME_MAIN_MENU,
   GAME_PLAYING,
+  GAME_REPLAY, /* watching a recorded game */
   } GameState;
 
 typedef enum {
@@ -132,7 +166,20 @@ typedef struct {
   /* general */
   SDL_Window *window;
   SDL_Renderer *renderer;
-  SDL_Texture *textures[NUM_TEXTURES];
+  Atlas atlas;
+  
+  /* whether TEXTURE_BLOCK_SPRITES has every color as a finished block,
+   * hover variants in its second row. Not without render targets */
+  bool has_block_sprites;
+  
+  ButtonTexture button_textures[MAX_BUTTON_TEXTURES];
+  
+  Readout score_readout;
+  Readout move_readout; /* how far into a replay */
+  int num_button_textures;
+  unsigned button_clock;
+  
+  bool render_targets; /* whether the renderer can render to textures */
   
   GameState state;
   int window_size[2];
@@ -143,23 +190,72 @@ typedef struct {
   
   float dt;
   
+  /* set whenever something on screen changes, frames are only drawn when it's set */
+  bool dirty;
+  bool presented; /* whether the last frame was drawn */
+  
   /* ingame stuff */
-  uint8_t board[BOARD_SIZE * BOARD_SIZE];
+  Game game;
+  Random rng; /* seeds every new game, so a whole session replays from one seed */
   
-  Shape selection[SELECTION_SIZE];
   int dragging_shape;
+  DragPreview drag_preview; /* only valid while dragging */
+  int mouse_position[2]; /* as of the last frame */
+  
+  bool restart_hovered;
   
   PlayingState playing_state;
   
+  int board_size; /* cells per side, picked at startup */
+  int cell_px;    /* the size of a cell on screen */
+  int tray_px;    /* the size of a cell of the shapes in the selection */
+  
+  unsigned board_version; /* bumped every time the board changes */
+  
+  /* the board is drawn into a texture where only the cells that changed are redrawn,
+   * NULL when the renderer can't render to textures */
+  SDL_Texture *board_texture;
+  uint8_t board_cells[MAX_BOARD_SIZE * MAX_BOARD_SIZE]; /* what every cell of board_texture shows */
+  
   float game_over_anim_timer;
   int game_over_squares_left;
   
-  int score;
+  /* hints */
+  HintEngine *hint;
+  bool show_hint;
+  bool waiting_for_hint;
+  bool has_hint;
+  Move hint_move; /* what's highlighted, only valid with has_hint */
+  
+  bool vsync;
+  
+  /* frame timing overlay, toggled with F3 */
+  Profiler profile;
+  
+  /* every game is recorded with --record, see replay.h */
+  Recorder recorder;
+  
+  /* the replay in GAME_REPLAY */
+  Playback playback;
+  int replay_move; /* the moves of it that are on the board */
+  bool replay_paused;
+  float replay_timer;
   } GameContext;
 
+void set_render_target(GameContext *ctx, SDL_Texture *texture) {
+  /* the queued sprites belong to the old target */
+  atlas_flush(&ctx->atlas, ctx->renderer);
+  SDL_SetRenderTarget(ctx->renderer, texture);
+  }
+
 void draw_block_rect(GameContext *ctx, int x, int y, int w, int h, SDL_Color color) {
   /* crazy but it works */
-  SDL_Texture *block_texture = ctx->textures[TEXTURE_BLOCK];
+  TRACE_BEGIN("draw_block_rect");
+  
+  atlas_flush(&ctx->atlas, ctx->renderer);
+  
+  SDL_Texture *block_texture = ctx->atlas.texture;
+  SDL_Rect block = ctx->atlas.sprites[TEXTURE_BLOCK];
   
   SDL_SetRenderDrawColor(ctx->renderer, color.r, color.g, color.b, 255);
   SDL_RenderFillRect(ctx->renderer, &(SDL_Rect) {x, y, w, h});
@@ -167,19 +263,19 @@ void draw_block_rect(GameContext *ctx, int x, int y, int w, int h, SDL_Color col
   SDL_SetTextureAlphaMod(block_texture, BLOCK_ALPHA_MOD);
   SDL_SetTextureBlendMode(block_texture, SDL_BLENDMODE_BLEND);
   
-  SDL_RenderCopy(ctx->renderer, block_texture, &(SDL_Rect) {0, 0, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX}, &(SDL_Rect) {x, y, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX});
+  SDL_RenderCopy(ctx->renderer, block_texture, &(SDL_Rect) {block.x, block.y, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX}, &(SDL_Rect) {x, y, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX});
   SDL_SetRenderDrawColor(ctx->renderer, block_texture_colors[0], block_texture_colors[0], block_texture_colors[0], BLOCK_ALPHA_MOD);
   SDL_RenderFillRect(ctx->renderer, &(SDL_Rect) {x+BLOCK_TEXTURE_SIDE_PX, y, w-BLOCK_TEXTURE_SIDE_PX*2, BLOCK_TEXTURE_SIDE_PX});
   
-  SDL_RenderCopy(ctx->renderer, block_texture, &(SDL_Rect) {BLOCK_SIZE_PX-BLOCK_TEXTURE_SIDE_PX, 0, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX}, &(SDL_Rect) {x+w-BLOCK_TEXTURE_SIDE_PX, y, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX});
+  SDL_RenderCopy(ctx->renderer, block_texture, &(SDL_Rect) {block.x+BLOCK_SIZE_PX-BLOCK_TEXTURE_SIDE_PX, block.y, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX}, &(SDL_Rect) {x+w-BLOCK_TEXTURE_SIDE_PX, y, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX});
   SDL_SetRenderDrawColor(ctx->renderer, block_texture_colors[1], block_texture_colors[1], block_texture_colors[1], BLOCK_ALPHA_MOD);
   SDL_RenderFillRect(ctx->renderer, &(SDL_Rect) {x+w-BLOCK_TEXTURE_SIDE_PX, y+BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX, h-BLOCK_TEXTURE_SIDE_PX*2});
   
-  SDL_RenderCopy(ctx->renderer, block_texture, &(SDL_Rect) {BLOCK_SIZE_PX-BLOCK_TEXTURE_SIDE_PX, BLOCK_SIZE_PX-BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX}, &(SDL_Rect) {x+w-BLOCK_TEXTURE_SIDE_PX, y+h-BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX});
+  SDL_RenderCopy(ctx->renderer, block_texture, &(SDL_Rect) {block.x+BLOCK_SIZE_PX-BLOCK_TEXTURE_SIDE_PX, block.y+BLOCK_SIZE_PX-BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX}, &(SDL_Rect) {x+w-BLOCK_TEXTURE_SIDE_PX, y+h-BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX});
   SDL_SetRenderDrawColor(ctx->renderer, block_texture_colors[2], block_texture_colors[2], block_texture_colors[2], BLOCK_ALPHA_MOD);
   SDL_RenderFillRect(ctx->renderer, &(SDL_Rect) {x+BLOCK_TEXTURE_SIDE_PX, y+h-BLOCK_TEXTURE_SIDE_PX, w-BLOCK_TEXTURE_SIDE_PX*2, BLOCK_TEXTURE_SIDE_PX});
   
-  SDL_RenderCopy(ctx->renderer, block_texture, &(SDL_Rect) {0, BLOCK_SIZE_PX-BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX}, &(SDL_Rect) {x, y+h-BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX});
+  SDL_RenderCopy(ctx->renderer, block_texture, &(SDL_Rect) {block.x, block.y+BLOCK_SIZE_PX-BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX}, &(SDL_Rect) {x, y+h-BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX});
   SDL_SetRenderDrawColor(ctx->renderer, block_texture_colors[3], block_texture_colors[3], block_texture_colors[3], BLOCK_ALPHA_MOD);
   SDL_RenderFillRect(ctx->renderer, &(SDL_Rect) {x, y+BLOCK_TEXTURE_SIDE_PX, BLOCK_TEXTURE_SIDE_PX, h-BLOCK_TEXTURE_SIDE_PX*2});
   
@@ -191,106 +287,409 @@ void draw_block_rect(GameContext *ctx, int x, int y, int w, int h, SDL_Color col
   
   SDL_SetRenderDrawColor(ctx->renderer, block_texture_colors[5], block_texture_colors[5], block_texture_colors[5], BLOCK_ALPHA_MOD);
   SDL_RenderDrawRect(ctx->renderer, &(SDL_Rect) {x+BLOCK_TEXTURE_SIDE_PX, y+BLOCK_TEXTURE_SIDE_PX, w-BLOCK_TEXTURE_SIDE_PX*2, h-BLOCK_TEXTURE_SIDE_PX*2});
+  
+  /* the atlas is shared with sprites that aren't faded */
+  SDL_SetTextureAlphaMod(block_texture, 255);
+  
+  TRACE_END("draw_block_rect");
   }
 
-bool button_frame(GameContext *ctx, int x, int y, int w, int h, int texture_id, int color_id, int mouse_position[2], bool just_clicked) {
-  SDL_Color color = colors[color_id];
-  bool retval = false;
+bool button_frame(GameContext *ctx, SDL_Rect rect, bool *hovered, int mouse_position[2], bool just_clicked) {
+  /* updates the hover state of a button, returns whether it was clicked */
+  bool is_hovered = mouse_position[X] > rect.x && mouse_position[X] < rect.x+rect.w
+                 && mouse_position[Y] > rect.y && mouse_position[Y] < rect.y+rect.h;
+  
+  if (is_hovered != *hovered) {
+    *hovered = is_hovered;
+    ctx->dirty = true;
+    }
   
-  if (mouse_position[0] > x && mouse_position[0] < x+w) {
-    if (mouse_position[1] > y && mouse_position[1] < y+h) {
-      color = AdjustColorBrightness(color, 35);
-      
-      if (just_clicked) retval = true;
+  return is_hovered && just_clicked;
+  }
+
+void draw_nine_slice(GameContext *ctx, SDL_Rect source, int border, SDL_Rect rect) {
+  /* the corners stay as they are, the edges are stretched along and the middle both ways */
+  int source_x[4] = {source.x, source.x + border, source.x + source.w - border, source.x + source.w};
+  int source_y[4] = {source.y, source.y + border, source.y + source.h - border, source.y + source.h};
+  int x[4] = {rect.x, rect.x + border, rect.x + rect.w - border, rect.x + rect.w};
+  int y[4] = {rect.y, rect.y + border, rect.y + rect.h - border, rect.y + rect.h};
+  
+  for (int row=0; row<3; row ++) {
+    for (int column=0; column<3; column ++) {
+      atlas_draw(&ctx->atlas, ctx->renderer,
+        (SDL_Rect) {source_x[column], source_y[row], source_x[column+1] - source_x[column], source_y[row+1] - source_y[row]},
+        (SDL_Rect) {x[column], y[row], x[column+1] - x[column], y[row+1] - y[row]});
       }
     }
+  }
+
+void compose_button(GameContext *ctx, SDL_Rect rect, int texture_id, int color_id, bool hovered) {
+  /* a nine-slice of the finished block sprite, its bevel is BLOCK_TEXTURE_SIDE_PX wide */
+  if (ctx->has_block_sprites) {
+    SDL_Rect blocks = ctx->atlas.sprites[TEXTURE_BLOCK_SPRITES];
+    SDL_Rect block = {blocks.x + color_id * BLOCK_SIZE_PX, blocks.y + hovered * BLOCK_SIZE_PX, BLOCK_SIZE_PX, BLOCK_SIZE_PX};
+    
+    draw_nine_slice(ctx, block, BLOCK_TEXTURE_SIDE_PX, rect);
+    }
+  else {
+    SDL_Color color = colors[color_id];
+    if (hovered) color = AdjustColorBrightness(color, HOVER_BRIGHTNESS);
+    
+    draw_block_rect(ctx, rect.x, rect.y, rect.w, rect.h, color);
+    }
   
-  draw_block_rect(ctx, x, y, w, h, color);
+  SDL_Rect icon = ctx->atlas.sprites[texture_id];
+  atlas_draw_sprite(&ctx->atlas, ctx->renderer, texture_id, rect.x+(rect.w/2-icon.w/2), rect.y+(rect.h/2-icon.h/2));
+  }
+
+SDL_Texture *button_texture(GameContext *ctx, SDL_Rect rect, int texture_id, int color_id, bool hovered) {
+  /* the cached texture of a button, composed the first time it's drawn,
+   * NULL when it can't be cached */
+  ctx->button_clock ++;
   
-  SDL_Texture *texture = ctx->textures[texture_id];
+  for (int i=0; i<ctx->num_button_textures; i ++) {
+    ButtonTexture *cached = &ctx->button_textures[i];
+    
+    if (cached->w == rect.w && cached->h == rect.h && cached->texture_id == texture_id
+     && cached->color_id == color_id && cached->hovered == hovered) {
+      cached->last_used = ctx->button_clock;
+      return cached->texture;
+      }
+    }
   
-  int texture_width, texture_height;
-  if (SDL_QueryTexture(texture, NULL, NULL, &texture_width, &texture_height))
-    handle_sdl_error();
+  if (!ctx->render_targets) return NULL;
   
-  Blit(ctx->renderer, texture, x+(w/2-texture_width/2), y+(h/2-texture_height/2));
+  /* a free slot, or the one that went undrawn the longest */
+  int slot = ctx->num_button_textures;
   
-  return retval;
+  if (slot == MAX_BUTTON_TEXTURES) {
+    slot = 0;
+    for (int i=1; i<MAX_BUTTON_TEXTURES; i ++) {
+      if (ctx->button_textures[i].last_used < ctx->button_textures[slot].last_used) slot = i;
+      }
+    
+    SDL_DestroyTexture(ctx->button_textures[slot].texture);
+    ctx->button_textures[slot] = ctx->button_textures[-- ctx->num_button_textures];
+    slot = ctx->num_button_textures;
+    }
+  
+  SDL_Texture *texture = SDL_CreateTexture(ctx->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, rect.w, rect.h);
+  if (!texture) return NULL;
+  
+  SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+  
+  TRACE_BEGIN("compose_button");
+  set_render_target(ctx, texture);
+  compose_button(ctx, (SDL_Rect) {0, 0, rect.w, rect.h}, texture_id, color_id, hovered);
+  set_render_target(ctx, NULL);
+  TRACE_END("compose_button");
+  
+  ctx->button_textures[slot] = (ButtonTexture) {rect.w, rect.h, texture_id, color_id, hovered, texture, ctx->button_clock};
+  ctx->num_button_textures ++;
+  
+  return texture;
+  }
+
+void free_button_textures(GameContext *ctx) {
+  for (int i=0; i<ctx->num_button_textures; i ++)
+    SDL_DestroyTexture(ctx->button_textures[i].texture);
+  
+  ctx->num_button_textures = 0;
   }
 
-void segment_display_frame(GameContext *ctx, int x, int y, int value, int digits) {
+void draw_button(GameContext *ctx, SDL_Rect rect, int texture_id, int color_id, bool hovered) {
+  SDL_Texture *texture = button_texture(ctx, rect, texture_id, color_id, hovered);
+  
+  atlas_flush(&ctx->atlas, ctx->renderer);
+  
+  if (texture)
+    SDL_RenderCopy(ctx->renderer, texture, NULL, &rect);
+  else
+    compose_button(ctx, rect, texture_id, color_id, hovered);
+  }
+
+void compose_segment_display(GameContext *ctx, int x, int y, int value, int digits) {
+  TRACE_BEGIN("compose_segment_display");
+  
   int digit;
-  int starting_x = x + digits * 22;
+  int starting_x = x + digits * SEGMENT_SPACING_PX;
   int screen_x = starting_x;
   
   bool draw_zero = false;
   if (value == 0)
     draw_zero = true;
   
+  /* the minus goes in front of the highest digit */
+  bool negative = value < 0;
+  if (negative) value = -value;
+  
+  /* digits + 1 slots, less one for the minus. A value that doesn't fit shows the
+   * biggest one that does instead of losing its high digits or its sign */
+  int limit = 1;
+  for (int i=0; i<digits + 1 - negative; i ++) limit *= 10;
+  if (value > limit - 1) value = limit - 1;
+  
   while (screen_x >= x) {
-    Blit(ctx->renderer, ctx->textures[TEXTURE_7SEGMENT_BG], screen_x, y);
+    atlas_draw_sprite(&ctx->atlas, ctx->renderer, TEXTURE_7SEGMENT_BG, screen_x, y);
     if (value) {
       digit = value % 10;
-      Blit(ctx->renderer, ctx->textures[TEXTURE_7SEGMENT_0 + digit], screen_x, y);
+      atlas_draw_sprite(&ctx->atlas, ctx->renderer, TEXTURE_7SEGMENT_0 + digit, screen_x, y);
       value /= 10;
       }
-    screen_x -= 22;
+    else if (negative) {
+      atlas_draw_sprite(&ctx->atlas, ctx->renderer, TEXTURE_7SEGMENT_MINUS, screen_x, y);
+      negative = false;
+      }
+    screen_x -= SEGMENT_SPACING_PX;
     }
   
   if (draw_zero)
-    Blit(ctx->renderer, ctx->textures[TEXTURE_7SEGMENT_0], starting_x, y);
+    atlas_draw_sprite(&ctx->atlas, ctx->renderer, TEXTURE_7SEGMENT_0, starting_x, y);
+  
+  TRACE_END("compose_segment_display");
+  }
+
+void readout_init(Readout *readout, int digits) {
+  readout->digits = digits;
+  readout->texture = NULL;
+  readout->valid = false;
+  }
+
+void readout_free(Readout *readout) {
+  if (readout->texture) SDL_DestroyTexture(readout->texture);
+  readout->texture = NULL;
+  readout->valid = false;
+  }
+
+void draw_readout(GameContext *ctx, Readout *readout, int x, int y, int value) {
+  /* the digits are only composed again when the value changed */
+  SDL_Rect sprite = ctx->atlas.sprites[TEXTURE_7SEGMENT_BG];
+  int w = readout->digits * SEGMENT_SPACING_PX + sprite.w;
+  
+  if (!readout->texture && ctx->render_targets) {
+    readout->texture = SDL_CreateTexture(ctx->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, sprite.h);
+    if (readout->texture) SDL_SetTextureBlendMode(readout->texture, SDL_BLENDMODE_NONE);
+    }
+  
+  if (!readout->texture) {
+    compose_segment_display(ctx, x, y, value, readout->digits);
+    return;
+    }
+  
+  if (!readout->valid || readout->value != value) {
+    set_render_target(ctx, readout->texture);
+    
+    /* readouts sit on the black background */
+    SDL_SetRenderDrawColor(ctx->renderer, 0, 0, 0, 255);
+    SDL_RenderClear(ctx->renderer);
+    
+    compose_segment_display(ctx, 0, 0, value, readout->digits);
+    set_render_target(ctx, NULL);
+    
+    readout->value = value;
+    readout->valid = true;
+    }
+  
+  atlas_flush(&ctx->atlas, ctx->renderer);
+  SDL_RenderCopy(ctx->renderer, readout->texture, NULL, &(SDL_Rect) {x, y, w, sprite.h});
+  }
+
+void compose_block(GameContext *ctx, int screen_x, int screen_y, int size_px, SDL_Color color) {
+  /* a block is its color with the shading of res/block.png blended over it */
+  atlas_flush(&ctx->atlas, ctx->renderer);
+  
+  SDL_SetRenderDrawColor(ctx->renderer, color.r, color.g, color.b, 255);
+  SDL_RenderFillRect(ctx->renderer, &(SDL_Rect) {screen_x, screen_y, size_px, size_px});
+  
+  SDL_SetTextureAlphaMod(ctx->atlas.texture, BLOCK_ALPHA_MOD);
+  SDL_RenderCopy(ctx->renderer, ctx->atlas.texture, &ctx->atlas.sprites[TEXTURE_BLOCK], &(SDL_Rect) {screen_x, screen_y, size_px, size_px});
+  SDL_SetTextureAlphaMod(ctx->atlas.texture, 255);
+  }
+
+void build_atlas_texture(GameContext *ctx) {
+  /* uploads the atlas and composes the finished blocks into it when it can be rendered to */
+  TRACE_BEGIN("build_atlas_texture");
+  
+  if (ctx->atlas.texture) SDL_DestroyTexture(ctx->atlas.texture);
+  
+  ctx->atlas.texture = SDL_CreateTextureFromSurface(ctx->renderer, ctx->atlas.surface);
+  if (!ctx->atlas.texture) handle_sdl_error();
+  
+  ctx->has_block_sprites = false;
+  
+  SDL_Texture *target = NULL;
+  if (ctx->render_targets)
+    target = SDL_CreateTexture(ctx->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, ctx->atlas.surface->w, ctx->atlas.surface->h);
+  
+  if (target) {
+    set_render_target(ctx, target);
+    
+    SDL_SetTextureBlendMode(ctx->atlas.texture, SDL_BLENDMODE_NONE);
+    SDL_RenderCopy(ctx->renderer, ctx->atlas.texture, NULL, NULL);
+    SDL_SetTextureBlendMode(ctx->atlas.texture, SDL_BLENDMODE_BLEND);
+    
+    /* composed from the uploaded copy, a texture can't be drawn from while it's rendered to */
+    SDL_Rect blocks = ctx->atlas.sprites[TEXTURE_BLOCK_SPRITES];
+    
+    for (int color=0; color<NUM_COLORS; color ++) {
+      compose_block(ctx, blocks.x + color * BLOCK_SIZE_PX, blocks.y, BLOCK_SIZE_PX, colors[color]);
+      compose_block(ctx, blocks.x + color * BLOCK_SIZE_PX, blocks.y + BLOCK_SIZE_PX, BLOCK_SIZE_PX, AdjustColorBrightness(colors[color], HOVER_BRIGHTNESS));
+      }
+    
+    set_render_target(ctx, NULL);
+    
+    SDL_DestroyTexture(ctx->atlas.texture);
+    ctx->atlas.texture = target;
+    ctx->has_block_sprites = true;
+    }
+  
+  SDL_SetTextureBlendMode(ctx->atlas.texture, SDL_BLENDMODE_BLEND);
+  
+  TRACE_END("build_atlas_texture");
   }
 
-void generate_selection(GameContext *ctx);
+void draw_block(GameContext *ctx, int screen_x, int screen_y, int size_px, int color_id, bool hovered) {
+  if (!ctx->has_block_sprites) {
+    compose_block(ctx, screen_x, screen_y, size_px, hovered ? AdjustColorBrightness(colors[color_id], HOVER_BRIGHTNESS) : colors[color_id]);
+    return;
+    }
+  
+  SDL_Rect blocks = ctx->atlas.sprites[TEXTURE_BLOCK_SPRITES];
+  
+  atlas_draw(&ctx->atlas, ctx->renderer,
+    (SDL_Rect) {blocks.x + color_id * BLOCK_SIZE_PX, blocks.y + hovered * BLOCK_SIZE_PX, BLOCK_SIZE_PX, BLOCK_SIZE_PX},
+    (SDL_Rect) {screen_x, screen_y, size_px, size_px});
+  }
 
-void clear_board(uint8_t *board) {
-  memset(board, 0, sizeof(board[0]) * BOARD_SIZE * BOARD_SIZE);
+int board_px(GameContext *ctx) {
+  return ctx->board_size * ctx->cell_px;
   }
 
-void init(GameContext *ctx) {
-  srand(time(NULL));
+void create_board_texture(GameContext *ctx) {
+  /* stays NULL without render targets, every cell of it is drawn again */
+  if (ctx->board_texture) SDL_DestroyTexture(ctx->board_texture);
   
-  ctx->window_size[WIDTH] = BOARD_SIZE * BLOCK_SIZE_PX + 100;
-  ctx->window_size[HEIGHT] = BOARD_SIZE * BLOCK_SIZE_PX + 250;
+  ctx->board_texture = SDL_CreateTexture(ctx->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, board_px(ctx), board_px(ctx));
+  if (ctx->board_texture) SDL_SetTextureBlendMode(ctx->board_texture, SDL_BLENDMODE_NONE);
+  
+  memset(ctx->board_cells, CELL_UNKNOWN, sizeof(ctx->board_cells));
+  }
+
+void reset_cached_textures(GameContext *ctx, bool device_lost) {
+  /* a targets reset loses what the render targets showed, a device reset loses
+   * the textures themselves. Either way everything is drawn into them again */
+  build_atlas_texture(ctx);
+  free_button_textures(ctx);
+  
+  if (device_lost) {
+    /* made again the next time they're drawn */
+    readout_free(&ctx->score_readout);
+    readout_free(&ctx->move_readout);
+    create_board_texture(ctx);
+    }
+  else {
+    ctx->score_readout.valid = false;
+    ctx->move_readout.valid = false;
+    memset(ctx->board_cells, CELL_UNKNOWN, sizeof(ctx->board_cells));
+    }
+  
+  ctx->dirty = true;
+  }
+
+void init(GameContext *ctx, uint64_t seed, bool fair_deal, int board_size, const char *record_path) {
+  core_init();
+  
+  printf("seed: %llu\n", (unsigned long long) seed);
+  random_seed(&ctx->rng, seed);
+  
+  ctx->board_size = board_size;
+  ctx->cell_px = MAX_BOARD_PX / board_size;
+  if (ctx->cell_px > BLOCK_SIZE_PX) ctx->cell_px = BLOCK_SIZE_PX;
+  
+  /* the selection under the board fits the widest shapes of the rules side by side,
+   * the window is tall enough for the tallest */
+  int widest = 1, tallest = 1;
+  for (int i=0; i<rules->num_shapes; i ++) {
+    if (rules->shapes[i].width > widest) widest = rules->shapes[i].width;
+    if (rules->shapes[i].height > tallest) tallest = rules->shapes[i].height;
+    }
+  
+  ctx->window_size[WIDTH] = board_px(ctx) + 100;
+  
+  ctx->tray_px = BLOCK_SIZE_PX;
+  
+  if (widest > TRAY_SHAPE_CELLS) {
+    int tray_width = ctx->window_size[WIDTH] - (SELECTION_SIZE + 1) * SELECTION_PADDING;
+    int fitted = tray_width / (SELECTION_SIZE * widest);
+    if (fitted < ctx->tray_px) ctx->tray_px = fitted;
+    }
+  
+  ctx->window_size[HEIGHT] = BOARD_TOP_PX + board_px(ctx) + SELECTION_PADDING + tallest * ctx->tray_px + TRAY_BOTTOM_PX;
   
   /* Create the window and SDL renderer */
   ctx->window = SDL_CreateWindow("blocks", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, ctx->window_size[WIDTH], ctx->window_size[HEIGHT], 0);
   if (!ctx->window) handle_sdl_error();
   
-  ctx->renderer = SDL_CreateRenderer(ctx->window, -1, SDL_RENDERER_ACCELERATED);
+  ctx->renderer = SDL_CreateRenderer(ctx->window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+  if (!ctx->renderer) ctx->renderer = SDL_CreateRenderer(ctx->window, -1, SDL_RENDERER_ACCELERATED);
   if (!ctx->renderer) handle_sdl_error();
   
+  /* without vsync the main loop limits itself to FPS */
+  SDL_RendererInfo renderer_info;
+  bool has_info = !SDL_GetRendererInfo(ctx->renderer, &renderer_info);
+  
+  ctx->vsync = has_info && (renderer_info.flags & SDL_RENDERER_PRESENTVSYNC);
+  ctx->render_targets = has_info && (renderer_info.flags & SDL_RENDERER_TARGETTEXTURE);
+  
   SDL_SetRenderDrawBlendMode(ctx->renderer, SDL_BLENDMODE_BLEND);
   
   ctx->last = SDL_GetPerformanceCounter();
   
-  /* Load textures */
-  ctx->textures[TEXTURE_BLOCK]       = IMG_LoadTexture(ctx->renderer, "res/block.png");
-  ctx->textures[TEXTURE_BLOCK_EMPTY] = IMG_LoadTexture(ctx->renderer, "res/block_empty.png");
-  ctx->textures[TEXTURE_RESTART]     = IMG_LoadTexture(ctx->renderer, "res/restart_button.png");
+  /* the atlas was packed at build time, its pixels are used as they are */
+  if (!atlas_load(&ctx->atlas, (void *) packed_pixels, PACKED_ATLAS_WIDTH, PACKED_ATLAS_HEIGHT, packed_sprites, NUM_TEXTURES)) {
+    handle_sdl_error();
+    exit(1);
+    }
+  
+  build_atlas_texture(ctx);
   
-  ctx->textures[TEXTURE_7SEGMENT_0] = IMG_LoadTexture(ctx->renderer, "res/7seg0.png");
-  ctx->textures[TEXTURE_7SEGMENT_1] = IMG_LoadTexture(ctx->renderer, "res/7seg1.png");
-  ctx->textures[TEXTURE_7SEGMENT_2] = IMG_LoadTexture(ctx->renderer, "res/7seg2.png");
-  ctx->textures[TEXTURE_7SEGMENT_3] = IMG_LoadTexture(ctx->renderer, "res/7seg3.png");
-  ctx->textures[TEXTURE_7SEGMENT_4] = IMG_LoadTexture(ctx->renderer, "res/7seg4.png");
-  ctx->textures[TEXTURE_7SEGMENT_5] = IMG_LoadTexture(ctx->renderer, "res/7seg5.png");
-  ctx->textures[TEXTURE_7SEGMENT_6] = IMG_LoadTexture(ctx->renderer, "res/7seg6.png");
-  ctx->textures[TEXTURE_7SEGMENT_7] = IMG_LoadTexture(ctx->renderer, "res/7seg7.png");
-  ctx->textures[TEXTURE_7SEGMENT_8] = IMG_LoadTexture(ctx->renderer, "res/7seg8.png");
-  ctx->textures[TEXTURE_7SEGMENT_9] = IMG_LoadTexture(ctx->renderer, "res/7seg9.png");
-  ctx->textures[TEXTURE_7SEGMENT_BG] = IMG_LoadTexture(ctx->renderer, "res/7segbg.png");
-  ctx->textures[TEXTURE_7SEGMENT_MINUS] = IMG_LoadTexture(ctx->renderer, "res/7segminus.png");
+  ctx->num_button_textures = 0;
+  ctx->button_clock = 0;
   
-  if (!ctx->textures[0]) handle_sdl_error();
+  readout_init(&ctx->score_readout, 4);
+  readout_init(&ctx->move_readout, 4);
   
-  /* Clear the board */
-  clear_board(ctx->board);
+  ctx->board_texture = NULL;
+  create_board_texture(ctx);
   
-  generate_selection(ctx);
+  /* Clear the board and generate the first selection */
+  ctx->game.fair_deal = fair_deal;
+  ctx->game.board_size = board_size;
+  ctx->game.recorder = NULL;
+  
+  recorder_init(&ctx->recorder);
+  if (record_path && recorder_open(&ctx->recorder, record_path))
+    ctx->game.recorder = &ctx->recorder;
+  
+  new_game(&ctx->game, random_next(&ctx->rng));
+  ctx->board_version = 0;
   
   /* no shape is currently being dragged */
   ctx->dragging_shape = NOT_DRAGGING;
+  ctx->drag_preview.valid = false;
+  ctx->mouse_position[X] = ctx->mouse_position[Y] = 0;
+  ctx->restart_hovered = false;
+  
+  /* hints are toggled with H */
+  ctx->hint = hint_create();
+  ctx->show_hint = false;
+  ctx->waiting_for_hint = false;
+  ctx->has_hint = false;
+  ctx->hint_move = (Move) {0};
+  
+  /* the first frame is always drawn */
+  ctx->dirty = true;
+  ctx->presented = false;
   
   /* start in the main menu */
   ctx->state = GAME_MAIN_MENU;
@@ -298,91 +697,67 @@ void init(GameContext *ctx) {
   ctx->playing_state = PLAYING;
   }
 
-void get_solved(uint8_t *board, bool *rows, bool *columns) {
-  bool is_full;
+void draw_cell(GameContext *ctx, int screen_x, int screen_y, uint8_t cell) {
+  if (cell == CELL_EMPTY)
+    atlas_draw(&ctx->atlas, ctx->renderer, ctx->atlas.sprites[TEXTURE_BLOCK_EMPTY], (SDL_Rect) {screen_x, screen_y, ctx->cell_px, ctx->cell_px});
+  else
+    draw_block(ctx, screen_x, screen_y, ctx->cell_px, cell, false);
+  }
+
+void draw_board(GameContext *ctx, int board_position[2], uint8_t *cells) {
+  TRACE_BEGIN("draw_board");
   
-  /* X */
-  for (int row=0; row<BOARD_SIZE; row++) {
-    is_full = true;
-    
-    for (int x=0; x<BOARD_SIZE; x++) {
-      if (!board[row * BOARD_SIZE + x]) {
-        is_full = false;
-        break;
-        }
-      }
+  int size = ctx->board_size;
+  
+  if (!ctx->board_texture) {
+    /* no render targets, draw every cell straight to the screen */
+    for (int index=0; index<size * size; index ++)
+      draw_cell(ctx, board_position[X] + index % size * ctx->cell_px, board_position[Y] + index / size * ctx->cell_px, cells[index]);
     
-    if (is_full) rows[row] = true;
+    TRACE_END("draw_board");
+    return;
     }
   
-  /* Y */
-  for (int column=0; column<BOARD_SIZE; column++) {
-    is_full = true;
+  /* redraw the cells that look different than last time into the board texture */
+  bool targeting = false;
+  
+  for (int index=0; index<size * size; index ++) {
+    if (cells[index] == ctx->board_cells[index]) continue;
     
-    for (int y=0; y<BOARD_SIZE; y++) {
-      if (!board[y * BOARD_SIZE + column]) {
-        is_full = false;
-        break;
-        }
+    if (!targeting) {
+      set_render_target(ctx, ctx->board_texture);
+      targeting = true;
       }
     
-    if (is_full) columns[column] = true;
+    /* every cell sprite is opaque, it replaces what was there */
+    draw_cell(ctx, index % size * ctx->cell_px, index / size * ctx->cell_px, cells[index]);
+    ctx->board_cells[index] = cells[index];
     }
-  }
-
-void clear_solved(uint8_t *board, int *cleared_x, int *cleared_y) {
-  bool rows[BOARD_SIZE] = {false};
-  bool columns[BOARD_SIZE] = {false};
   
-  get_solved(board, rows, columns);
+  if (targeting) set_render_target(ctx, NULL);
   
-  for (int row=0; row<BOARD_SIZE; row++) {
-    if (!rows[row]) continue;
-    memset(board + row * BOARD_SIZE, 0, sizeof(uint8_t) * BOARD_SIZE);
-    
-    (*cleared_x) ++;
-    }
+  atlas_flush(&ctx->atlas, ctx->renderer);
+  SDL_RenderCopy(ctx->renderer, ctx->board_texture, NULL, &(SDL_Rect) {board_position[X], board_position[Y], board_px(ctx), board_px(ctx)});
   
-  for (int column=0; column<BOARD_SIZE; column++) {
-    if (!columns[column]) continue;
-    for (int y=0; y<BOARD_SIZE; y++)
-      board[y * BOARD_SIZE + column] = 0;
-    
-    (*cleared_y) ++;
-    }
+  TRACE_END("draw_board");
   }
 
-void generate_selection(GameContext *ctx) {
-  /* Generate selection */
-  for (int i=0; i<SELECTION_SIZE; i ++) {
-    ctx->selection[i] = shape_from_template(randint(0, NUM_TEMPLATES-1), randint(1, NUM_COLORS-1));
-    }
-  }
-
-void draw_block(GameContext *ctx, int screen_x, int screen_y, SDL_Color color) {
-  SDL_SetRenderDrawColor(ctx->renderer, color.r, color.g, color.b, 255);
-  SDL_RenderFillRect(ctx->renderer, &(SDL_Rect) {screen_x, screen_y, BLOCK_SIZE_PX, BLOCK_SIZE_PX});
+void draw_shape(GameContext *ctx, Shape shape, int screen_x, int screen_y, int block_px) {
+  TRACE_BEGIN("draw_shape");
   
-  SDL_Texture *texture = ctx->textures[TEXTURE_BLOCK];
+  const ShapeCell *cells = shape_cells(&shape);
   
-  SDL_SetTextureAlphaMod(texture, BLOCK_ALPHA_MOD);
-  SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
-  Blit(ctx->renderer, texture, screen_x, screen_y);
-  }
-
-void draw_shape(GameContext *ctx, Shape shape, int screen_x, int screen_y) {
-  for (int block_x=0; block_x<shape.width; block_x ++) {
-    for (int block_y=0; block_y<shape.height; block_y ++) {
-      if (shape.data[block_y * shape.width + block_x] != '1') continue;
-      
-      draw_block(ctx, block_x * BLOCK_SIZE_PX + screen_x, block_y * BLOCK_SIZE_PX + screen_y, colors[shape.color]);
-      }
+  for (int i=0; i<shape.num_cells; i ++) {
+    ShapeCell cell = cells[i];
+    draw_block(ctx, cell.x * block_px + screen_x, cell.y * block_px + screen_y, block_px, shape.color, false);
     }
+  
+  TRACE_END("draw_shape");
   }
 
-bool shape_is_hovered(Shape shape, int screen_x, int screen_y, int mouse_x, int mouse_y) {
-  int width_px = shape.width * BLOCK_SIZE_PX;
-  int height_px = shape.height * BLOCK_SIZE_PX;
+bool shape_is_hovered(Shape shape, int screen_x, int screen_y, int block_px, int mouse_x, int mouse_y) {
+  int width_px = shape.width * block_px;
+  int height_px = shape.height * block_px;
   
   /* Rectangle check */
   if (!(mouse_x > screen_x && mouse_x < screen_x + width_px)
@@ -390,257 +765,377 @@ bool shape_is_hovered(Shape shape, int screen_x, int screen_y, int mouse_x, int
     return false;
   
   /* Precise check */
-  int block_x = floor((float) (mouse_x - screen_x) / (float) BLOCK_SIZE_PX);
-  int block_y = floor((float) (mouse_y - screen_y) / (float) BLOCK_SIZE_PX);
+  int block_x = floor((float) (mouse_x - screen_x) / (float) block_px);
+  int block_y = floor((float) (mouse_y - screen_y) / (float) block_px);
   
   ASSERT(block_x >= 0, "block_x !>= 0");
   ASSERT(block_y >= 0, "block_y !>= 0");
   ASSERT(block_x < shape.width, "block_x > shape.width");
   ASSERT(block_y < shape.height, "block_y > shape.height");
   
-  if (shape.data[block_y * shape.width + block_x] != '1')
+  if (!(shape.rows[block_y] & (1 << block_x)))
     return false;
   
   return true;
   }
 
-bool can_place_shape(uint8_t *board, Shape shape, int block_x, int block_y) {
-  if (block_x < 0 || block_y < 0 || block_x + shape.width > BOARD_SIZE || block_y + shape.height > BOARD_SIZE)
-    return false;
+SDL_Rect restart_button_rect(GameContext *ctx, int board_position[2]) {
+  return (SDL_Rect) {
+    board_position[X] + board_px(ctx) - (BLOCK_SIZE_PX * 2),
+    board_position[Y] - BLOCK_SIZE_PX - 8,
+    BLOCK_SIZE_PX * 2, BLOCK_SIZE_PX,
+    };
+  }
+
+void selection_layout(GameContext *ctx, int board_position[2], int screen_x[SELECTION_SIZE], int *screen_y) {
+  /* the selection is centered under the board, used up shapes keep their space */
+  int selection_width = 0;
   
-  for (int shape_x=0; shape_x < shape.width; shape_x ++) {
-    for (int shape_y=0; shape_y < shape.height; shape_y ++) {
-      if (shape.data[shape_y * shape.width + shape_x] != '1') continue;
-      if (block_x + shape_x >= BOARD_SIZE || block_y + shape_y >= BOARD_SIZE) return false;
-      
-      int index = (block_y + shape_y) * BOARD_SIZE + (block_x + shape_x);
-      if (board[index]) return false;
-      }
+  for (int i=0; i<SELECTION_SIZE; i ++)
+    selection_width += ctx->game.selection[i].width * ctx->tray_px + SELECTION_PADDING;
+  
+  selection_width -= SELECTION_PADDING;
+  
+  int x = board_position[X] + board_px(ctx) / 2 - selection_width / 2;
+  for (int i=0; i<SELECTION_SIZE; i ++) {
+    screen_x[i] = x;
+    x += ctx->game.selection[i].width * ctx->tray_px + SELECTION_PADDING;
     }
   
-  return true;
+  *screen_y = board_position[Y] + board_px(ctx) + SELECTION_PADDING;
   }
 
-bool can_place_shape_anywhere(uint8_t *board, Shape shape) {
-  for (int block_x = 0; block_x < BOARD_SIZE; block_x ++) {
-    for (int block_y = 0; block_y < BOARD_SIZE; block_y ++) {
-      if (can_place_shape(board, shape, block_x, block_y)) return true;
-      }
-    }
+void drag_position(GameContext *ctx, Shape shape, int mouse_position[2], int *screen_x, int *screen_y) {
+  /* the dragged shape is drawn at the board's scale, above the mouse */
+  *screen_x = mouse_position[X] - shape.width * ctx->cell_px / 2;
+  *screen_y = mouse_position[Y] - shape.height * ctx->cell_px - MOUSE_DRAG_PADDING;
+  }
+
+void drag_target(GameContext *ctx, Shape shape, int board_position[2], int mouse_position[2], int *block_x, int *block_y) {
+  /* the cell the dragged shape would be dropped on */
+  int screen_x, screen_y;
+  drag_position(ctx, shape, mouse_position, &screen_x, &screen_y);
   
-  return false;
+  *block_x = round((float) (screen_x - board_position[X]) / (float) ctx->cell_px);
+  *block_y = round((float) (screen_y - board_position[Y]) / (float) ctx->cell_px);
   }
 
-bool place_shape(uint8_t *board, Shape shape, int block_x, int block_y) {
-  /* Check if the shape can be placed */
-  if (!can_place_shape(board, shape, block_x, block_y)) return false;
+void update_drag_preview(GameContext *ctx, int board_position[2], int mouse_position[2]) {
+  const Shape drag_shape = ctx->game.selection[ctx->dragging_shape];
+  DragPreview *preview = &ctx->drag_preview;
+  int block_x, block_y;
   
-  for (int shape_x=0; shape_x < shape.width; shape_x ++) {
-    for (int shape_y=0; shape_y < shape.height; shape_y ++) {
-      if (shape.data[shape_y * shape.width + shape_x] != '1') continue;
-      
-      int index = (block_y + shape_y) * BOARD_SIZE + (block_x + shape_x);
-      board[index] = (uint8_t) shape.color;
-      }
+  drag_target(ctx, drag_shape, board_position, mouse_position, &block_x, &block_y);
+  
+  if (preview->valid
+   && preview->shape == ctx->dragging_shape
+   && preview->block_x == block_x && preview->block_y == block_y
+   && preview->board_version == ctx->board_version)
+    return;
+  
+  preview->valid = true;
+  preview->shape = ctx->dragging_shape;
+  preview->block_x = block_x;
+  preview->block_y = block_y;
+  preview->board_version = ctx->board_version;
+  
+  preview->can_place = can_place_shape(&ctx->game.board, drag_shape, block_x, block_y);
+  bitboard_clear(&preview->placed, ctx->board_size);
+  bitboard_clear(&preview->lines, ctx->board_size);
+  
+  if (preview->can_place) {
+    int num_rows = 0, num_columns = 0;
+    Bitboard next;
+    
+    bitboard_place(&preview->placed, drag_shape, block_x, block_y);
+    
+    bitboard_copy(&next, &ctx->game.board.occupied);
+    bitboard_place(&next, drag_shape, block_x, block_y);
+    full_lines(&next, &preview->lines, &num_rows, &num_columns);
     }
   
-  return true;
+  ctx->dirty = true;
   }
 
-void frame_playing(GameContext *ctx, int board_position[2], int mouse_position[2], bool mouse_down, bool just_clicked) {
-  uint8_t predicted_board[BOARD_SIZE * BOARD_SIZE] = {0};
-  memcpy(predicted_board, ctx->board, sizeof(uint8_t) * BOARD_SIZE * BOARD_SIZE);
+void update_playing(GameContext *ctx, int board_position[2], int mouse_position[2], bool mouse_down, bool just_clicked) {
+  /* game logic only, everything that changes what's on screen sets ctx->dirty */
+  TRACE_BEGIN("update_playing");
+  profile_begin(&ctx->profile, ZONE_LOGIC);
   
-  bool do_restart = button_frame(ctx,
-    board_position[X] + BOARD_SIZE * BLOCK_SIZE_PX - (BLOCK_SIZE_PX * 2),
-    board_position[Y] - BLOCK_SIZE_PX - 8,
-    BLOCK_SIZE_PX * 2, BLOCK_SIZE_PX,
-    TEXTURE_RESTART, 1,
-    mouse_position,
-    just_clicked);
-  
-  if (do_restart) {
+  if (button_frame(ctx, restart_button_rect(ctx, board_position), &ctx->restart_hovered, mouse_position, just_clicked)) {
     ctx->playing_state = PLAYING;
-    ctx->score = 0;
-    generate_selection(ctx);
-    clear_board(ctx->board);
+    new_game(&ctx->game, random_next(&ctx->rng));
+    ctx->board_version ++;
+    ctx->dirty = true;
     }
   
-  segment_display_frame(ctx, board_position[X], board_position[Y] - 40, ctx->score, 4);
+  /* the dragged shape follows the mouse */
+  if (ctx->dragging_shape != NOT_DRAGGING
+   && (mouse_position[X] != ctx->mouse_position[X] || mouse_position[Y] != ctx->mouse_position[Y]))
+    ctx->dirty = true;
   
-  bool can_place;
-  int block_x, block_y;
-  const Shape drag_shape = ctx->selection[ctx->dragging_shape];
+  ctx->mouse_position[X] = mouse_position[X];
+  ctx->mouse_position[Y] = mouse_position[Y];
   
   /* Place the dragged shape if the mouse is released and the shape is in bounds */
-  {
-    int screen_x = mouse_position[X] - drag_shape.width * BLOCK_SIZE_PX / 2;
-    int screen_y = mouse_position[Y] - drag_shape.height * BLOCK_SIZE_PX - MOUSE_DRAG_PADDING;
+  if (ctx->dragging_shape != NOT_DRAGGING && !mouse_down) {
+    const Shape drag_shape = ctx->game.selection[ctx->dragging_shape];
+    int block_x, block_y;
     
-    block_x = round((float) (screen_x - board_position[X]) / (float) BLOCK_SIZE_PX);
-    block_y = round((float) (screen_y - board_position[Y]) / (float) BLOCK_SIZE_PX);
+    drag_target(ctx, drag_shape, board_position, mouse_position, &block_x, &block_y);
     
-    can_place = place_shape(predicted_board, drag_shape, block_x, block_y);
+    if (can_place_shape(&ctx->game.board, drag_shape, block_x, block_y)) {
+      apply_move(&ctx->game, (Move) {ctx->dragging_shape, block_x, block_y});
+      ctx->board_version ++;
+      }
     
-    if (ctx->dragging_shape != NOT_DRAGGING && !mouse_down) {
-      int index = block_y * BOARD_SIZE + block_x;
-      
-      if (index < BOARD_SIZE * BOARD_SIZE) {
-        if (place_shape(ctx->board, drag_shape, block_x, block_y)) {
-          int cleared_x = 0;
-          int cleared_y = 0;
-          clear_solved(ctx->board, &cleared_x, &cleared_y);
-          
-          int score_x = cleared_x * BOARD_SIZE;
-          int score_y = cleared_y * BOARD_SIZE;
-          
-          ctx->score += score_x + score_y + (score_x * score_y / 2);
-          ctx->selection[ctx->dragging_shape].color = 0;
-          
-          /* Regenerate the selection when all the blocks are used up */
-          {
-            bool do_generate = true;
-            
-            Shape shape;
-            for (int i=0; i<SELECTION_SIZE; i ++) {
-              shape = ctx->selection[i];
-              
-              if (shape.color) {
-                do_generate = false;
-                break;
-                }
-              }
-            
-            if (do_generate)
-              generate_selection(ctx);
-            }
-          
-          /* Check if the game should be over */
-          bool can_place_anything = false;
-          for (int i=0; i<SELECTION_SIZE; i++) {
-            Shape shape = ctx->selection[i];
-            
-            if (!shape.color) continue;
-            if (can_place_shape_anywhere(ctx->board, shape))
-              can_place_anything = true;
-            }
-          
-          if (!can_place_anything && ctx->playing_state != GAME_OVER_ANIMATION) {
-            ctx->playing_state = GAME_OVER_ANIMATION;
-            ctx->game_over_squares_left = BOARD_SIZE * BOARD_SIZE;
-            ctx->game_over_anim_timer = 0;
-            }
-          }
-        }
-      
-      ctx->dragging_shape = NOT_DRAGGING;
+    if (is_over(&ctx->game) && ctx->playing_state != GAME_OVER_ANIMATION) {
+      ctx->playing_state = GAME_OVER_ANIMATION;
+      ctx->game_over_squares_left = ctx->board_size * ctx->board_size;
+      ctx->game_over_anim_timer = 0;
       }
+    
+    ctx->dragging_shape = NOT_DRAGGING;
+    ctx->drag_preview.valid = false;
+    ctx->dirty = true;
     }
   
   if (ctx->playing_state == GAME_OVER_ANIMATION) {
     ctx->game_over_anim_timer -= ctx->dt;
     
     if (ctx->game_over_anim_timer <= 0) {
-      ctx->game_over_anim_timer = 2000 / (BOARD_SIZE * BOARD_SIZE);
-      ctx->board[BOARD_SIZE * BOARD_SIZE - ctx->game_over_squares_left] = 1;
-      ctx->game_over_squares_left --;
+      /* the board fills up in the same time whatever its size, big boards fill several cells a frame */
+      int num_cells = ctx->board_size * ctx->board_size;
+      
+      while (ctx->game_over_anim_timer <= 0 && ctx->game_over_squares_left > 0) {
+        ctx->game_over_anim_timer += 2000.0f / num_cells;
+        fill_cell(&ctx->game.board, num_cells - ctx->game_over_squares_left, 1);
+        ctx->game_over_squares_left --;
+        }
       
       if (ctx->game_over_squares_left <= 0) {
         ctx->playing_state = PLAYING;
-        clear_board(ctx->board);
-        generate_selection(ctx);
-        ctx->score = 0;
+        new_game(&ctx->game, random_next(&ctx->rng));
         }
+      
+      ctx->board_version ++;
+      
+      ctx->dirty = true;
       }
     }
   
+  /* Pick up a shape from the selection */
+  if (just_clicked && ctx->dragging_shape == NOT_DRAGGING) {
+    int screen_x[SELECTION_SIZE], screen_y;
+    selection_layout(ctx, board_position, screen_x, &screen_y);
+    
+    for (int i=0; i<SELECTION_SIZE; i ++) {
+      Shape shape = ctx->game.selection[i];
+      
+      if (shape.color && shape_is_hovered(shape, screen_x[i], screen_y, ctx->tray_px, mouse_position[X], mouse_position[Y])) {
+        ctx->dragging_shape = i;
+        ctx->dirty = true;
+        }
+      }
+    }
+  
+  if (ctx->dragging_shape != NOT_DRAGGING)
+    update_drag_preview(ctx, board_position, mouse_position);
+  
+  /* the best placement, shown once the hint worker has found it */
+  bool has_hint = false;
+  Move hint_move = {0};
+  ctx->waiting_for_hint = false;
+  
+  if (ctx->show_hint && ctx->playing_state != GAME_OVER_ANIMATION) {
+    Solution solution;
+    
+    hint_request(ctx->hint, &ctx->game.board, ctx->game.selection);
+    if (!hint_get(ctx->hint, &solution))
+      ctx->waiting_for_hint = true;
+    else if (solution.num_moves) {
+      has_hint = true;
+      hint_move = solution.moves[0];
+      }
+    }
+  
+  if (has_hint != ctx->has_hint || memcmp(&hint_move, &ctx->hint_move, sizeof(Move))) {
+    ctx->has_hint = has_hint;
+    ctx->hint_move = hint_move;
+    ctx->dirty = true;
+    }
+  
+  profile_end(&ctx->profile, ZONE_LOGIC);
+  TRACE_END("update_playing");
+  }
+
+void seek_replay(GameContext *ctx, int move) {
+  /* one move forward is played on, anything else starts from the nearest snapshot */
+  if (move < 0) move = 0;
+  if (move > ctx->playback.num_moves) move = ctx->playback.num_moves;
+  
+  if (move == ctx->replay_move + 1)
+    apply_move(&ctx->game, ctx->playback.moves[ctx->replay_move]);
+  else if (move != ctx->replay_move)
+    playback_seek(&ctx->playback, move, &ctx->game);
+  
+  ctx->replay_move = move;
+  
+  /* the next move is highlighted like a hint */
+  ctx->has_hint = move < ctx->playback.num_moves;
+  if (ctx->has_hint) ctx->hint_move = ctx->playback.moves[move];
+  
+  ctx->board_version ++;
+  ctx->dirty = true;
+  }
+
+void replay_key(GameContext *ctx, SDL_Keycode key) {
+  /* space plays and pauses, the arrows step a move, page up and down a snapshot */
+  int move = ctx->replay_move;
+  
+  switch (key) {
+    case SDLK_SPACE: ctx->replay_paused = !ctx->replay_paused; ctx->replay_timer = 0; return;
+    case SDLK_RIGHT: move ++; break;
+    case SDLK_LEFT: move --; break;
+    case SDLK_PAGEDOWN: move += SNAPSHOT_INTERVAL; break;
+    case SDLK_PAGEUP: move -= SNAPSHOT_INTERVAL; break;
+    case SDLK_HOME: move = 0; break;
+    case SDLK_END: move = ctx->playback.num_moves; break;
+    default: return;
+    }
+  
+  ctx->replay_paused = true;
+  seek_replay(ctx, move);
+  }
+
+void update_replay(GameContext *ctx) {
+  if (ctx->replay_paused) return;
+  
+  ctx->replay_timer -= ctx->dt;
+  if (ctx->replay_timer > 0) return;
+  
+  ctx->replay_timer += REPLAY_MOVE_MS;
+  
+  if (ctx->replay_move < ctx->playback.num_moves)
+    seek_replay(ctx, ctx->replay_move + 1);
+  else
+    ctx->replay_paused = true;
+  }
+
+bool start_replay(GameContext *ctx, const uint8_t *data, size_t size, int game) {
+  /* shows a game of a replay file instead of playing, false when there's no such game to show */
+  size_t *offsets;
+  int num_games = replay_index(data, size, &offsets);
+  
+  if (game < 0 || game >= num_games || !playback_load(&ctx->playback, data, size, offsets[game])) {
+    printf("replay: no game %d to show, the file has %d\n", game, num_games < 0 ? 0 : num_games);
+    free(offsets);
+    return false;
+    }
+  
+  free(offsets);
+  
+  ReplayResult *result = &ctx->playback.result;
+  printf("replay: game %d of %d, %d moves, score %d, %s\n", game, num_games, result->num_moves, result->score, replay_status_names[result->status]);
+  
+  ctx->state = GAME_REPLAY;
+  ctx->replay_move = 0;
+  ctx->replay_paused = false;
+  ctx->replay_timer = REPLAY_MOVE_MS;
+  
+  playback_seek(&ctx->playback, 0, &ctx->game);
+  seek_replay(ctx, 0);
+  
+  return true;
+  }
+
+void draw_playing(GameContext *ctx, int board_position[2], int mouse_position[2], bool mouse_down) {
+  TRACE_BEGIN("draw_playing");
+  
+  if (ctx->state == GAME_REPLAY) {
+    /* the move counter takes the restart button's place */
+    int width = ctx->move_readout.digits * SEGMENT_SPACING_PX + ctx->atlas.sprites[TEXTURE_7SEGMENT_BG].w;
+    draw_readout(ctx, &ctx->move_readout, board_position[X] + board_px(ctx) - width, board_position[Y] - 40, ctx->replay_move);
+    }
+  else
+    draw_button(ctx, restart_button_rect(ctx, board_position), TEXTURE_RESTART, 1, ctx->restart_hovered);
+  
+  draw_readout(ctx, &ctx->score_readout, board_position[X], board_position[Y] - 40, score(&ctx->game));
+  
   /* Draw the board */
+  profile_begin(&ctx->profile, ZONE_BOARD);
   {
-    /* get the blocks that should be highlighted */
-    bool rows[BOARD_SIZE] = {false};
-    bool columns[BOARD_SIZE] = {false};
-    
-    if (ctx->playing_state != GAME_OVER_ANIMATION)
-      get_solved(predicted_board, rows, columns);
+    atlas_flush(&ctx->atlas, ctx->renderer);
     
     SDL_SetRenderDrawColor(ctx->renderer, 200, 200, 200, 255);
-    SDL_RenderDrawRect(ctx->renderer, &(SDL_Rect) {board_position[X]-1, board_position[Y]-1, BOARD_SIZE * BLOCK_SIZE_PX+2, BOARD_SIZE * BLOCK_SIZE_PX+2});
+    SDL_RenderDrawRect(ctx->renderer, &(SDL_Rect) {board_position[X]-1, board_position[Y]-1, board_px(ctx)+2, board_px(ctx)+2});
     
-    int screen_x, screen_y, x, y, index;
-    bool highlight;
+    /* the dragged shape and the lines it would complete are highlighted */
+    int size = ctx->board_size;
+    Bitboard preview;
     
-    for (int x=0; x<BOARD_SIZE; x ++) {
-      for (int y=0; y<BOARD_SIZE; y ++) {
-        screen_x = BLOCK_SIZE_PX * x + board_position[X];
-        screen_y = BLOCK_SIZE_PX * y + board_position[Y];
-        index = y * BOARD_SIZE + x;
-        
-        highlight = rows[y] || columns[x];
-        
-        if (can_place && mouse_down) {
-          int x_rel = x - block_x;
-          int y_rel = y - block_y;
-          
-          if (x_rel >= 0 && y_rel >= 0 && x_rel < drag_shape.width && y_rel < drag_shape.height) {
-            if (drag_shape.data[y_rel * drag_shape.width + x_rel] == '1') highlight = true;
-            }
-          }
+    bitboard_clear(&preview, size);
+    
+    if (ctx->dragging_shape != NOT_DRAGGING && ctx->playing_state != GAME_OVER_ANIMATION) {
+      for (int y=0; y<size; y ++) {
+        preview.rows[y] = ctx->drag_preview.lines.rows[y];
+        if (mouse_down) preview.rows[y] |= ctx->drag_preview.placed.rows[y];
+        }
+      }
+    
+    if (ctx->has_hint) {
+      Move move = ctx->hint_move;
+      bitboard_place(&preview, ctx->game.selection[move.shape], move.x, move.y);
+      }
+    
+    uint8_t cells[MAX_BOARD_SIZE * MAX_BOARD_SIZE];
+    
+    for (int y=0; y<size; y ++) {
+      for (int x=0; x<size; x ++) {
+        int index = y * size + x;
         
-        if (highlight)
-          draw_block(ctx, screen_x, screen_y, colors[0]);
-        else if (ctx->board[index])
-          draw_block(ctx, screen_x, screen_y, colors[ctx->board[index]]);
+        if (IS_OCCUPIED(&preview, x, y))
+          cells[index] = 0;
+        else if (IS_OCCUPIED(&ctx->game.board.occupied, x, y))
+          cells[index] = ctx->game.board.colors[index];
         else
-          Blit(ctx->renderer, ctx->textures[TEXTURE_BLOCK_EMPTY], screen_x, screen_y);
+          cells[index] = CELL_EMPTY;
         }
       }
+    
+    draw_board(ctx, board_position, cells);
     }
   
-  /* Draw and update the selection area */
+  profile_end(&ctx->profile, ZONE_BOARD);
+  
+  /* Draw the selection area */
+  profile_begin(&ctx->profile, ZONE_SELECTION);
   {
-    const int padding = 10;
-    int center_x, screen_x, screen_y;
-    Shape shape;
-    int selection_width = 0;
-    
-    /* Calculate the total width of the selection area */
-    for (int i=0; i<SELECTION_SIZE; i ++) {
-      shape = ctx->selection[i];
-      selection_width += shape.width * BLOCK_SIZE_PX + padding;
-      }
-    
-    selection_width -= padding;
-    screen_x = board_position[X] + BOARD_SIZE * BLOCK_SIZE_PX / 2 - selection_width / 2;
+    int screen_x[SELECTION_SIZE], screen_y;
+    selection_layout(ctx, board_position, screen_x, &screen_y);
     
-    /* Draw and update it */
     for (int i=0; i<SELECTION_SIZE; i ++) {
-      shape = ctx->selection[i];
+      Shape shape = ctx->game.selection[i];
       
-      if (shape.color == 0) goto skip;
+      if (shape.color == 0) continue;
       
       if (ctx->dragging_shape == i) {
-        int drag_screen_x = mouse_position[X] - shape.width * BLOCK_SIZE_PX / 2;
-        screen_y = mouse_position[Y] - shape.height * BLOCK_SIZE_PX - MOUSE_DRAG_PADDING;
+        int drag_screen_x, drag_screen_y;
+        drag_position(ctx, shape, mouse_position, &drag_screen_x, &drag_screen_y);
         
-        draw_shape(ctx, shape, drag_screen_x, screen_y);
+        draw_shape(ctx, shape, drag_screen_x, drag_screen_y, ctx->cell_px);
         }
-      else {
-        screen_y = board_position[Y] + BOARD_SIZE * BLOCK_SIZE_PX + padding;
-        
-        draw_shape(ctx, shape, screen_x, screen_y);
-        
-        if (shape_is_hovered(shape, screen_x, screen_y, mouse_position[X], mouse_position[Y]) && just_clicked) {
-          ctx->dragging_shape = i;
-          }
-        }
-      
-      skip:
-      screen_x += shape.width * BLOCK_SIZE_PX + padding;
+      else
+        draw_shape(ctx, shape, screen_x[i], screen_y, ctx->tray_px);
       }
     }
+  profile_end(&ctx->profile, ZONE_SELECTION);
+  TRACE_END("draw_playing");
   }
 
 bool frame(GameContext *ctx) {
+  TRACE_BEGIN("frame");
+  
   /* Delta Time*/
   ctx->start_frame = SDL_GetPerformanceCounter();
   ctx->dt = (float) ((ctx->start_frame - ctx->last) * 1000 / (float) SDL_GetPerformanceFrequency());
@@ -648,48 +1143,256 @@ bool frame(GameContext *ctx) {
   
   /* ... */
   
+  profile_begin(&ctx->profile, ZONE_INPUT);
+  TRACE_BEGIN("input");
+  
   bool just_clicked = false;
   SDL_Event event;
   while (SDL_PollEvent(&event)) {
-    if (event.type == SDL_QUIT) return true;
+    if (event.type == SDL_QUIT) {
+      TRACE_END("input");
+      TRACE_END("frame");
+      return true;
+      }
     if (event.type == SDL_MOUSEBUTTONDOWN) {
       if (event.button.button == SDL_BUTTON_LEFT) just_clicked = true;
       }
+    if (event.type == SDL_KEYDOWN) {
+      if (ctx->state == GAME_REPLAY) replay_key(ctx, event.key.keysym.sym);
+      else if (event.key.keysym.sym == SDLK_h) ctx->show_hint = !ctx->show_hint;
+      if (event.key.keysym.sym == SDLK_F3) ctx->profile.show = !ctx->profile.show;
+      if (event.key.keysym.sym == SDLK_F4) profile_print(&ctx->profile);
+      
+      ctx->dirty = true;
+      }
+    /* the window contents may have been lost */
+    if (event.type == SDL_WINDOWEVENT) ctx->dirty = true;
+    
+    /* and with them the cached textures */
+    if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET)
+      reset_cached_textures(ctx, event.type == SDL_RENDER_DEVICE_RESET);
     }
   
   int board_position[2] = {
-    ctx->window_size[WIDTH] / 2 - (BLOCK_SIZE_PX * BOARD_SIZE) / 2,
-    100
+    ctx->window_size[WIDTH] / 2 - board_px(ctx) / 2,
+    BOARD_TOP_PX
     };
   
   int mouse_position[2] = {0};
   uint32_t button_mask = SDL_GetMouseState(&mouse_position[X], &mouse_position[Y]);
   bool mouse_down = button_mask & SDL_BUTTON(1);
   
-  SDL_SetRenderDrawColor(ctx->renderer, 0, 0, 0, 255);
-  SDL_RenderClear(ctx->renderer);
+  TRACE_END("input");
+  profile_end(&ctx->profile, ZONE_INPUT);
   
   if (ctx->state == GAME_PLAYING) {
-    frame_playing(ctx, board_position, mouse_position, mouse_down, just_clicked);
+    update_playing(ctx, board_position, mouse_position, mouse_down, just_clicked);
+    }
+  else if (ctx->state == GAME_REPLAY) {
+    update_replay(ctx);
+    }
+  else if (ctx->state == GAME_MAIN_MENU) {
+    ctx->state = GAME_PLAYING;
+    ctx->dirty = true;
+    }
+  
+  /* the overlay shows the live timings */
+  if (ctx->profile.show) ctx->dirty = true;
+  
+  /* only draw when something on screen changed, the last frame stays up otherwise */
+  ctx->presented = ctx->dirty;
+  
+  if (ctx->dirty) {
+    ctx->dirty = false;
+    
+    SDL_SetRenderDrawColor(ctx->renderer, 0, 0, 0, 255);
+    SDL_RenderClear(ctx->renderer);
+    
+    if (ctx->state == GAME_PLAYING || ctx->state == GAME_REPLAY)
+      draw_playing(ctx, board_position, mouse_position, mouse_down);
+    
+    atlas_flush(&ctx->atlas, ctx->renderer);
+    
+    if (ctx->profile.show)
+      profile_draw(&ctx->profile, ctx->renderer, 4, 4);
+    
+    profile_begin(&ctx->profile, ZONE_PRESENT);
+    TRACE_BEGIN("present");
+    SDL_RenderPresent(ctx->renderer);
+    TRACE_END("present");
+    profile_end(&ctx->profile, ZONE_PRESENT);
     }
-  else if (ctx->state == GAME_MAIN_MENU) ctx->state = GAME_PLAYING;
   
-  SDL_RenderPresent(ctx->renderer);
   ctx->end_frame = SDL_GetPerformanceCounter();
+  profile_frame(&ctx->profile, ctx->start_frame, ctx->end_frame);
+  
+  TRACE_END("frame");
   
   return false;
   }
 
 void stop(GameContext *ctx) {
+  hint_destroy(ctx->hint);
+  profile_close(&ctx->profile);
+  
+  if (ctx->board_texture) SDL_DestroyTexture(ctx->board_texture);
+  atlas_free(&ctx->atlas);
+  free_button_textures(ctx);
+  readout_free(&ctx->score_readout);
+  readout_free(&ctx->move_readout);
+  
+  recorder_close(&ctx->recorder);
+  if (ctx->state == GAME_REPLAY) playback_free(&ctx->playback);
+  
+  /* after the hint worker has stopped adding events */
+  TRACE_FLUSH();
   SDL_DestroyRenderer(ctx->renderer);
   SDL_DestroyWindow(ctx->window);
   free(ctx);
   }
 
-int main() {
+char *get_option(int argc, char **argv, const char *flag, const char *env_name) {
+  /* the value after flag on the command line, then the environment variable */
+  for (int i=1; i<argc-1; i ++) {
+    if (!strcmp(argv[i], flag)) return argv[i+1];
+    }
+  
+  char *env = getenv(env_name);
+  if (env && *env) return env;
+  
+  return NULL;
+  }
+
+bool is_animating(GameContext *ctx) {
+  /* whether the next frame can look different without any input */
+  return ctx->state == GAME_MAIN_MENU
+      || (ctx->state == GAME_REPLAY && !ctx->replay_paused)
+      || ctx->playing_state == GAME_OVER_ANIMATION
+      || ctx->dragging_shape != NOT_DRAGGING
+      || ctx->waiting_for_hint
+      || ctx->profile.show;
+  }
+
+void wait_for_next_frame(GameContext *ctx) {
+  if (!is_animating(ctx)) {
+    /* nothing to draw until something happens, sleep until the next event */
+    SDL_WaitEventTimeout(NULL, IDLE_TIMEOUT_MS);
+    
+    /* the time spent waiting isn't animation time */
+    ctx->last = SDL_GetPerformanceCounter();
+    return;
+    }
+  
+  /* with vsync SDL_RenderPresent already waited for the display,
+   * a frame that wasn't drawn still has to be limited */
+  if (ctx->vsync && ctx->presented) return;
+  
+  uint64_t frequency = SDL_GetPerformanceFrequency();
+  uint64_t next_frame = ctx->start_frame + frequency / FPS;
+  uint64_t now = SDL_GetPerformanceCounter();
+  
+  if (now >= next_frame) return;
+  
+  uint32_t ms_left = (next_frame - now) * 1000 / frequency;
+  if (ms_left > FRAME_SPIN_MS) SDL_Delay(ms_left - FRAME_SPIN_MS);
+  
+  while (SDL_GetPerformanceCounter() < next_frame);
+  }
+
+uint64_t get_seed(int argc, char **argv) {
+  /* --seed N on the command line, then $BLOCKS_SEED, then the clock */
+  char *seed = get_option(argc, argv, "--seed", "BLOCKS_SEED");
+  if (seed) return strtoull(seed, NULL, 0);
+  
+  return SDL_GetPerformanceCounter();
+  }
+
+bool get_fair_deal(int argc, char **argv) {
+  /* --fair on the command line or BLOCKS_FAIR_DEAL=1 */
+  for (int i=1; i<argc; i ++) {
+    if (!strcmp(argv[i], "--fair")) return true;
+    }
+  
+  char *env = getenv("BLOCKS_FAIR_DEAL");
+  return env && atoi(env);
+  }
+
+int get_board_size(int argc, char **argv) {
+  /* --board-size N on the command line or $BLOCKS_BOARD_SIZE, then the ruleset's */
+  char *option = get_option(argc, argv, "--board-size", "BLOCKS_BOARD_SIZE");
+  if (!option) return rules->board_size;
+  
+  int size = atoi(option);
+  if (board_size_valid(size)) return size;
+  
+  printf("board size %s isn't between %d and %d, using %d\n", option, MAX_SHAPE_SIZE, MAX_BOARD_SIZE, rules->board_size);
+  return rules->board_size;
+  }
+
+void load_rules(int argc, char **argv) {
+  /* --rules file on the command line or $BLOCKS_RULES, the built in ones stay when it can't be loaded */
+  core_init();
+  
+  char *path = get_option(argc, argv, "--rules", "BLOCKS_RULES");
+  if (path) rules_load(path);
+  }
+
+uint8_t *read_replay(const char *path, size_t *size) {
+  /* the whole file, NULL when it can't be read */
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    printf("replay: can't open %s\n", path);
+    return NULL;
+    }
+  
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  
+  uint8_t *data = malloc(*size ? *size : 1);
+  if (fread(data, 1, *size, file) != *size) {
+    free(data);
+    data = NULL;
+    }
+  
+  fclose(file);
+  return data;
+  }
+
+int main(int argc, char **argv) {
   GameContext *ctx = malloc(sizeof(GameContext));
   
-  init(ctx);
+  load_rules(argc, argv);
+  
+  /* --replay file shows a recorded game instead, --replay-game N picks which one.
+   * The board is laid out for the replay's size */
+  char *replay_path = get_option(argc, argv, "--replay", "BLOCKS_REPLAY");
+  char *replay_game = get_option(argc, argv, "--replay-game", "BLOCKS_REPLAY_GAME");
+  
+  size_t replay_size = 0;
+  uint8_t *replay = replay_path ? read_replay(replay_path, &replay_size) : NULL;
+  
+  int board_size = get_board_size(argc, argv);
+  ReplayResult checked;
+  size_t *offsets;
+  int game = replay_game ? atoi(replay_game) : 0;
+  int num_games = replay ? replay_index(replay, replay_size, &offsets) : -1;
+  
+  if (game >= 0 && game < num_games) {
+    replay_check(replay, replay_size, offsets[game], &checked);
+    if (board_size_valid(checked.header.board_size)) board_size = checked.header.board_size;
+    }
+  if (num_games >= 0) free(offsets);
+  
+  init(ctx, get_seed(argc, argv), get_fair_deal(argc, argv), board_size, get_option(argc, argv, "--record", "BLOCKS_RECORD"));
+  
+  if (replay) {
+    start_replay(ctx, replay, replay_size, game);
+    free(replay);
+    }
+  
+  /* per frame zone timings are written to --profile-csv / $BLOCKS_PROFILE_CSV */
+  profile_init(&ctx->profile, get_option(argc, argv, "--profile-csv", "BLOCKS_PROFILE_CSV"));
   
   #ifdef __EMSCRIPTEN__
   
@@ -699,6 +1402,7 @@ int main() {
   
   while (1) {
     if (frame(ctx)) break;
+    wait_for_next_frame(ctx);
     }
   
   stop(ctx);
@@ -0,0 +1,108 @@
+/* Asset packer
+ * runs on the build machine: decodes res/, packs it into the sprite atlas and
+ * writes the atlas out as a C header. The game embeds that header, so it
+ * starts without decoding PNGs or opening any files */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "core.h"
+#include "atlas.h"
+#include "sprites.h"
+
+const char *sprite_paths[NUM_TEXTURES] = {
+  [TEXTURE_BLOCK]          = "res/block.png",
+  [TEXTURE_BLOCK_EMPTY]    = "res/block_empty.png",
+  [TEXTURE_RESTART]        = "res/restart_button.png",
+  [TEXTURE_7SEGMENT_0]     = "res/7seg0.png",
+  [TEXTURE_7SEGMENT_1]     = "res/7seg1.png",
+  [TEXTURE_7SEGMENT_2]     = "res/7seg2.png",
+  [TEXTURE_7SEGMENT_3]     = "res/7seg3.png",
+  [TEXTURE_7SEGMENT_4]     = "res/7seg4.png",
+  [TEXTURE_7SEGMENT_5]     = "res/7seg5.png",
+  [TEXTURE_7SEGMENT_6]     = "res/7seg6.png",
+  [TEXTURE_7SEGMENT_7]     = "res/7seg7.png",
+  [TEXTURE_7SEGMENT_8]     = "res/7seg8.png",
+  [TEXTURE_7SEGMENT_9]     = "res/7seg9.png",
+  [TEXTURE_7SEGMENT_BG]    = "res/7segbg.png",
+  [TEXTURE_7SEGMENT_MINUS] = "res/7segminus.png",
+  };
+
+/* pixels written per line of the header */
+#define PIXELS_PER_LINE 8
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    printf("usage: %s output.h\n", argv[0]);
+    return 1;
+    }
+  
+  SDL_Surface *surfaces[NUM_TEXTURES] = {NULL};
+  
+  for (int i=0; i<NUM_TEXTURES; i ++) {
+    if (i == TEXTURE_BLOCK_SPRITES)
+      surfaces[i] = SDL_CreateRGBSurfaceWithFormat(0, BLOCK_SPRITES_WIDTH, BLOCK_SPRITES_HEIGHT, 32, SDL_PIXELFORMAT_RGBA32);
+    else
+      surfaces[i] = IMG_Load(sprite_paths[i]);
+    
+    if (!surfaces[i]) {
+      printf("can't load %s: %s\n", sprite_paths[i] ? sprite_paths[i] : "blank sprite", SDL_GetError());
+      return 1;
+      }
+    }
+  
+  Atlas *atlas = malloc(sizeof(Atlas));
+  if (!atlas_pack(atlas, surfaces, NUM_TEXTURES)) {
+    printf("can't pack the atlas: %s\n", SDL_GetError());
+    return 1;
+    }
+  
+  FILE *file = fopen(argv[1], "w");
+  if (!file) {
+    printf("can't open %s\n", argv[1]);
+    return 1;
+    }
+  
+  SDL_Surface *surface = atlas->surface;
+  
+  fprintf(file, "/* generated by pack_res from res/, don't edit */\n\n");
+  fprintf(file, "#define PACKED_ATLAS_WIDTH %d\n", surface->w);
+  fprintf(file, "#define PACKED_ATLAS_HEIGHT %d\n\n", surface->h);
+  
+  fprintf(file, "static const SDL_Rect packed_sprites[%d] = {\n", NUM_TEXTURES);
+  for (int i=0; i<NUM_TEXTURES; i ++) {
+    SDL_Rect sprite = atlas->sprites[i];
+    fprintf(file, "  {%d, %d, %d, %d},\n", sprite.x, sprite.y, sprite.w, sprite.h);
+    }
+  fprintf(file, "  };\n\n");
+  
+  /* RGBA32 is r, g, b, a in memory, written out byte by byte so it doesn't depend on endianness */
+  fprintf(file, "static const uint8_t packed_pixels[%d] = {\n", surface->w * surface->h * 4);
+  
+  for (int y=0; y<surface->h; y ++) {
+    uint8_t *row = (uint8_t *) surface->pixels + y * surface->pitch;
+    
+    for (int x=0; x<surface->w; x ++) {
+      if (x % PIXELS_PER_LINE == 0) fprintf(file, "  ");
+      
+      uint8_t *pixel = row + x * 4;
+      fprintf(file, "%d,%d,%d,%d,", pixel[0], pixel[1], pixel[2], pixel[3]);
+      
+      if (x % PIXELS_PER_LINE == PIXELS_PER_LINE - 1 || x == surface->w - 1) fprintf(file, "\n");
+      }
+    }
+  
+  fprintf(file, "  };\n");
+  fclose(file);
+  
+  for (int i=0; i<NUM_TEXTURES; i ++)
+    SDL_FreeSurface(surfaces[i]);
+  
+  atlas_free(atlas);
+  free(atlas);
+  
+  return 0;
+  }
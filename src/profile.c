@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+/* frame time the overlay bars are scaled to, a full bar is two frames at 60 fps */
+#define PROFILE_BAR_MS 33.3f
+
+#define PROFILE_BAR_WIDTH 160
+#define PROFILE_ROW_HEIGHT 12
+
+const char *zone_names[NUM_ZONES] = {
+  "input",
+  "logic",
+  "board",
+  "selection",
+  "present",
+  "frame",
+  };
+
+const SDL_Color zone_colors[NUM_ZONES] = {
+  (SDL_Color) {230, 200, 60, 255},
+  (SDL_Color) {255, 53, 53, 255},
+  (SDL_Color) {72, 153, 94, 255},
+  (SDL_Color) {62, 92, 169, 255},
+  (SDL_Color) {180, 90, 200, 255},
+  (SDL_Color) {200, 200, 200, 255},
+  };
+
+static float counter_to_ms(uint64_t ticks) {
+  return (float) ((double) ticks * 1000.0 / (double) SDL_GetPerformanceFrequency());
+  }
+
+void profile_init(Profiler *profiler, const char *csv_path) {
+  memset(profiler, 0, sizeof(Profiler));
+  
+  if (!csv_path) return;
+  
+  profiler->csv = fopen(csv_path, "w");
+  if (!profiler->csv) {
+    printf("profile: can't open %s\n", csv_path);
+    return;
+    }
+  
+  for (int zone=0; zone<NUM_ZONES; zone ++)
+    fprintf(profiler->csv, zone ? ",%s" : "%s", zone_names[zone]);
+  fprintf(profiler->csv, "\n");
+  }
+
+void profile_close(Profiler *profiler) {
+  if (profiler->csv) fclose(profiler->csv);
+  profiler->csv = NULL;
+  }
+
+void profile_begin(Profiler *profiler, Zone zone) {
+  profiler->start[zone] = SDL_GetPerformanceCounter();
+  }
+
+void profile_end(Profiler *profiler, Zone zone) {
+  profiler->current[zone] += counter_to_ms(SDL_GetPerformanceCounter() - profiler->start[zone]);
+  }
+
+void profile_frame(Profiler *profiler, uint64_t frame_start, uint64_t frame_end) {
+  profiler->current[ZONE_FRAME] = counter_to_ms(frame_end - frame_start);
+  
+  for (int zone=0; zone<NUM_ZONES; zone ++) {
+    profiler->history[zone][profiler->next_frame] = profiler->current[zone];
+    
+    if (profiler->csv)
+      fprintf(profiler->csv, zone ? ",%.4f" : "%.4f", profiler->current[zone]);
+    
+    profiler->current[zone] = 0;
+    }
+  
+  if (profiler->csv) fprintf(profiler->csv, "\n");
+  
+  profiler->next_frame = (profiler->next_frame + 1) % PROFILE_HISTORY;
+  if (profiler->num_frames < PROFILE_HISTORY) profiler->num_frames ++;
+  }
+
+static int compare_floats(const void *a, const void *b) {
+  float x = *(const float *) a, y = *(const float *) b;
+  return (x > y) - (x < y);
+  }
+
+ZoneStats profile_stats(Profiler *profiler, Zone zone) {
+  ZoneStats stats = {0};
+  int count = profiler->num_frames;
+  if (!count) return stats;
+  
+  float sorted[PROFILE_HISTORY];
+  memcpy(sorted, profiler->history[zone], sizeof(float) * count);
+  qsort(sorted, count, sizeof(float), compare_floats);
+  
+  float sum = 0;
+  for (int i=0; i<count; i ++) sum += sorted[i];
+  
+  stats.min = sorted[0];
+  stats.avg = sum / count;
+  stats.p99 = sorted[(count - 1) * 99 / 100];
+  
+  return stats;
+  }
+
+void profile_print(Profiler *profiler) {
+  printf("%-10s %8s %8s %8s   (ms over %d frames)\n", "zone", "min", "avg", "p99", profiler->num_frames);
+  
+  for (int zone=0; zone<NUM_ZONES; zone ++) {
+    ZoneStats stats = profile_stats(profiler, zone);
+    printf("%-10s %8.3f %8.3f %8.3f\n", zone_names[zone], stats.min, stats.avg, stats.p99);
+    }
+  }
+
+static int bar_width(float ms) {
+  int width = (int) (ms / PROFILE_BAR_MS * PROFILE_BAR_WIDTH);
+  return width > PROFILE_BAR_WIDTH ? PROFILE_BAR_WIDTH : width;
+  }
+
+void profile_draw(Profiler *profiler, SDL_Renderer *renderer, int x, int y) {
+  /* one row per zone: a dim bar up to the p99, a full bar up to the average
+   * and a white tick at the minimum. The gray line marks the 60 fps budget */
+  const int swatch = PROFILE_ROW_HEIGHT - 4;
+  
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 200);
+  SDL_RenderFillRect(renderer, &(SDL_Rect) {x, y, PROFILE_BAR_WIDTH + swatch + 8, NUM_ZONES * PROFILE_ROW_HEIGHT + 4});
+  
+  for (int zone=0; zone<NUM_ZONES; zone ++) {
+    ZoneStats stats = profile_stats(profiler, zone);
+    SDL_Color color = zone_colors[zone];
+    
+    int row_y = y + 2 + zone * PROFILE_ROW_HEIGHT;
+    int bar_x = x + swatch + 6;
+    
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
+    SDL_RenderFillRect(renderer, &(SDL_Rect) {x + 2, row_y + 2, swatch, swatch});
+    
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 90);
+    SDL_RenderFillRect(renderer, &(SDL_Rect) {bar_x, row_y + 2, bar_width(stats.p99), swatch});
+    
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
+    SDL_RenderFillRect(renderer, &(SDL_Rect) {bar_x, row_y + 2, bar_width(stats.avg), swatch});
+    
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderFillRect(renderer, &(SDL_Rect) {bar_x + bar_width(stats.min), row_y + 2, 1, swatch});
+    }
+  
+  SDL_SetRenderDrawColor(renderer, 128, 128, 128, 255);
+  SDL_RenderFillRect(renderer, &(SDL_Rect) {x + swatch + 6 + bar_width(1000.0f / 60), y, 1, NUM_ZONES * PROFILE_ROW_HEIGHT + 4});
+  }
@@ -0,0 +1,57 @@
+/* Profiler
+ * times the parts of every frame and keeps a short history for the overlay */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+
+#include "core.h"
+
+/* frames of history the statistics are computed over */
+#define PROFILE_HISTORY 240
+
+typedef enum {
+  ZONE_INPUT,
+  ZONE_LOGIC,
+  ZONE_BOARD,
+  ZONE_SELECTION,
+  ZONE_PRESENT,
+  ZONE_FRAME,
+  NUM_ZONES,
+  } Zone;
+
+typedef struct {
+  float min;
+  float avg;
+  float p99;
+  } ZoneStats;
+
+typedef struct {
+  uint64_t start[NUM_ZONES];
+  float current[NUM_ZONES]; /* ms spent in each zone this frame */
+  
+  float history[NUM_ZONES][PROFILE_HISTORY];
+  int next_frame;
+  int num_frames;
+  
+  bool show;
+  FILE *csv;
+  } Profiler;
+
+void profile_init(Profiler *profiler, const char *csv_path);
+void profile_close(Profiler *profiler);
+
+void profile_begin(Profiler *profiler, Zone zone);
+void profile_end(Profiler *profiler, Zone zone);
+
+/* stores this frame's zone times, frame_start and frame_end are performance counter values */
+void profile_frame(Profiler *profiler, uint64_t frame_start, uint64_t frame_end);
+
+ZoneStats profile_stats(Profiler *profiler, Zone zone);
+void profile_print(Profiler *profiler);
+void profile_draw(Profiler *profiler, SDL_Renderer *renderer, int x, int y);
+
+#endif
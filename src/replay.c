@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+#include "rules.h"
+
+const char *replay_status_names[NUM_REPLAY_STATUSES] = {
+  "ok",
+  "unfinished",
+  "ended early",
+  "corrupt",
+  "wrong rules",
+  "bad deal",
+  "illegal move",
+  "bad score",
+  };
+
+/* ========== RECORDING ========== */
+
+static void put_varint(Recorder *recorder, uint64_t value) {
+  /* 7 bits a byte, the high bit is set on all but the last */
+  if (recorder->size + 10 > recorder->capacity) {
+    recorder->capacity = recorder->capacity ? recorder->capacity * 2 : 256;
+    recorder->data = realloc(recorder->data, recorder->capacity);
+    }
+  
+  while (value >= 0x80) {
+    recorder->data[recorder->size ++] = (uint8_t) value | 0x80;
+    value >>= 7;
+    }
+  
+  recorder->data[recorder->size ++] = (uint8_t) value;
+  }
+
+static void put_record(Recorder *recorder, RecordKind kind, uint64_t payload) {
+  put_varint(recorder, (payload << 2) | kind);
+  }
+
+static void flush_record(Recorder *recorder) {
+  /* a streamed replay is flushed every record, it's all there even when the game crashes */
+  if (!recorder->file) return;
+  
+  fwrite(recorder->data, 1, recorder->size, recorder->file);
+  fflush(recorder->file);
+  recorder->size = 0;
+  }
+
+void recorder_init(Recorder *recorder) {
+  recorder->data = NULL;
+  recorder->size = 0;
+  recorder->capacity = 0;
+  recorder->file = NULL;
+  recorder->board_size = 0;
+  }
+
+bool recorder_open(Recorder *recorder, const char *path) {
+  recorder_init(recorder);
+  
+  recorder->file = fopen(path, "wb");
+  if (!recorder->file) {
+    printf("replay: can't open %s\n", path);
+    return false;
+    }
+  
+  fwrite(REPLAY_MAGIC, 1, REPLAY_MAGIC_SIZE, recorder->file);
+  fflush(recorder->file);
+  return true;
+  }
+
+void recorder_close(Recorder *recorder) {
+  flush_record(recorder);
+  if (recorder->file) fclose(recorder->file);
+  
+  free(recorder->data);
+  recorder_init(recorder);
+  }
+
+void record_game(Recorder *recorder, uint64_t seed, const Game *game) {
+  recorder->board_size = game->board.occupied.size;
+  
+  put_record(recorder, RECORD_GAME, 0);
+  put_varint(recorder, seed);
+  put_varint(recorder, recorder->board_size);
+  put_varint(recorder, game->fair_deal);
+  put_varint(recorder, rules_hash());
+  flush_record(recorder);
+  }
+
+void record_deal(Recorder *recorder, const Shape *selection) {
+  put_record(recorder, RECORD_DEAL, 0);
+  
+  for (int i=0; i<SELECTION_SIZE; i ++)
+    put_varint(recorder, selection[i].template_id * NUM_COLORS + selection[i].color);
+  
+  flush_record(recorder);
+  }
+
+void record_move(Recorder *recorder, Move move) {
+  put_record(recorder, RECORD_MOVE, move.shape + SELECTION_SIZE * (move.x + recorder->board_size * move.y));
+  flush_record(recorder);
+  }
+
+void record_end(Recorder *recorder, int score) {
+  /* zigzag, so a ruleset with negative points doesn't need 10 bytes */
+  put_record(recorder, RECORD_END, ((uint64_t) score << 1) ^ (uint64_t) (score >> 31));
+  flush_record(recorder);
+  }
+
+/* ========== READING ========== */
+
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  size_t offset;
+  bool corrupt; /* set when a varint runs past the end */
+  } Reader;
+
+static uint64_t get_varint(Reader *reader) {
+  uint64_t value = 0;
+  
+  for (int shift=0; shift<64; shift += 7) {
+    if (reader->offset >= reader->size) break;
+    
+    uint8_t byte = reader->data[reader->offset ++];
+    value |= (uint64_t) (byte & 0x7f) << shift;
+    
+    if (!(byte & 0x80)) return value;
+    }
+  
+  reader->corrupt = true;
+  return 0;
+  }
+
+int replay_index(const uint8_t *data, size_t size, size_t **offsets) {
+  /* only reads the records, nothing is played */
+  if (size < REPLAY_MAGIC_SIZE || memcmp(data, REPLAY_MAGIC, REPLAY_MAGIC_SIZE)) {
+    *offsets = NULL;
+    return -1;
+    }
+  
+  Reader reader = {data, size, REPLAY_MAGIC_SIZE, false};
+  int num_games = 0, capacity = 64;
+  *offsets = malloc(sizeof(size_t) * capacity);
+  
+  while (reader.offset < size && !reader.corrupt) {
+    size_t start = reader.offset;
+    RecordKind kind = get_varint(&reader) & 3;
+    
+    if (kind == RECORD_GAME) {
+      if (num_games == capacity) {
+        capacity *= 2;
+        *offsets = realloc(*offsets, sizeof(size_t) * capacity);
+        }
+      
+      (*offsets)[num_games ++] = start;
+      for (int i=0; i<4; i ++) get_varint(&reader);
+      }
+    else if (kind == RECORD_DEAL) {
+      for (int i=0; i<SELECTION_SIZE; i ++) get_varint(&reader);
+      }
+    }
+  
+  return num_games;
+  }
+
+static bool read_header(Reader *reader, ReplayHeader *header) {
+  if ((get_varint(reader) & 3) != RECORD_GAME) return false;
+  
+  header->seed = get_varint(reader);
+  header->board_size = get_varint(reader);
+  header->fair_deal = get_varint(reader) != 0;
+  header->rules_hash = get_varint(reader);
+  
+  return !reader->corrupt;
+  }
+
+static void add_snapshot(Playback *playback, const Game *game) {
+  /* the arrays grow a snapshot's worth of moves at a time */
+  int n = playback->num_snapshots ++;
+  
+  playback->snapshots = realloc(playback->snapshots, sizeof(Game) * playback->num_snapshots);
+  playback->moves = realloc(playback->moves, sizeof(Move) * playback->num_snapshots * SNAPSHOT_INTERVAL);
+  playback->snapshots[n] = *game;
+  }
+
+static ReplayStatus play_replay(Reader *reader, ReplayResult *result, Playback *playback) {
+  /* plays the record through the real rules, keeping playback's moves and snapshots when it's set */
+  Game game;
+  
+  result->score = 0;
+  result->num_moves = 0;
+  
+  if (!read_header(reader, &result->header)) return REPLAY_CORRUPT;
+  
+  ReplayHeader *header = &result->header;
+  if (header->rules_hash != rules_hash() || !board_size_valid(header->board_size)) return REPLAY_WRONG_RULES;
+  
+  int size = header->board_size;
+  
+  game.recorder = NULL;
+  game.fair_deal = header->fair_deal;
+  game.board_size = size;
+  new_game(&game, header->seed);
+  
+  if (playback) add_snapshot(playback, &game);
+  
+  while (reader->offset < reader->size) {
+    size_t start = reader->offset;
+    uint64_t record = get_varint(reader);
+    uint64_t payload = record >> 2;
+    
+    if (reader->corrupt) return REPLAY_CORRUPT;
+    
+    switch ((RecordKind) (record & 3)) {
+      case RECORD_GAME:
+        /* the next game, this one was left before it was over */
+        reader->offset = start;
+        return REPLAY_UNFINISHED;
+      
+      case RECORD_DEAL:
+        for (int i=0; i<SELECTION_SIZE; i ++) {
+          uint64_t piece = get_varint(reader);
+          Shape *shape = &game.selection[i];
+          
+          if (reader->corrupt) return REPLAY_CORRUPT;
+          if (piece != shape->template_id * NUM_COLORS + shape->color) return REPLAY_BAD_DEAL;
+          }
+        break;
+      
+      case RECORD_MOVE: {
+        uint64_t cell = payload / SELECTION_SIZE;
+        Move move = {payload % SELECTION_SIZE, cell % size, cell / size};
+        
+        if (cell >= (uint64_t) (size * size) || !apply_move(&game, move)) return REPLAY_ILLEGAL_MOVE;
+        
+        if (playback) {
+          playback->moves[result->num_moves] = move;
+          if ((result->num_moves + 1) % SNAPSHOT_INTERVAL == 0) add_snapshot(playback, &game);
+          }
+        
+        result->num_moves ++;
+        result->score = game.score;
+        break;
+        }
+      
+      case RECORD_END: {
+        int score = (int) ((payload >> 1) ^ -(payload & 1));
+        
+        if (!is_over(&game)) return REPLAY_ENDED_EARLY;
+        return score == game.score ? REPLAY_OK : REPLAY_BAD_SCORE;
+        }
+      }
+    }
+  
+  return REPLAY_UNFINISHED;
+  }
+
+ReplayStatus replay_check(const uint8_t *data, size_t size, size_t offset, ReplayResult *result) {
+  Reader reader = {data, size, offset, false};
+  
+  result->status = play_replay(&reader, result, NULL);
+  return result->status;
+  }
+
+/* ========== PLAYBACK ========== */
+
+bool playback_load(Playback *playback, const uint8_t *data, size_t size, size_t offset) {
+  /* everything up to where the replay stops checking out can be watched */
+  Reader reader = {data, size, offset, false};
+  
+  playback->moves = NULL;
+  playback->snapshots = NULL;
+  playback->num_snapshots = 0;
+  
+  playback->result.status = play_replay(&reader, &playback->result, playback);
+  playback->num_moves = playback->result.num_moves;
+  
+  if (!playback->num_snapshots) {
+    playback_free(playback);
+    return false;
+    }
+  
+  return true;
+  }
+
+void playback_free(Playback *playback) {
+  free(playback->moves);
+  free(playback->snapshots);
+  
+  playback->moves = NULL;
+  playback->snapshots = NULL;
+  playback->num_moves = playback->num_snapshots = 0;
+  }
+
+void playback_seek(const Playback *playback, int move, Game *game) {
+  /* from the snapshot before it, at most SNAPSHOT_INTERVAL - 1 moves are played */
+  if (move < 0) move = 0;
+  if (move > playback->num_moves) move = playback->num_moves;
+  
+  int snapshot = move / SNAPSHOT_INTERVAL;
+  *game = playback->snapshots[snapshot];
+  
+  for (int i=snapshot * SNAPSHOT_INTERVAL; i<move; i ++)
+    apply_move(game, playback->moves[i]);
+  }
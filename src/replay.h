@@ -0,0 +1,110 @@
+/* Replays
+ * a game as a stream of varints. It starts with everything new_game needs,
+ * followed by every deal and move as it happened and the final score. A
+ * replay is checked by playing it again with the real rules, so a replay
+ * that doesn't play out the same way is caught.
+ *
+ * A replay file is REPLAY_MAGIC and any number of games:
+ *
+ *   game   seed, board size, fair deal, rules_hash
+ *   deal   SELECTION_SIZE times template_id * NUM_COLORS + color
+ *   move   in the record, shape + SELECTION_SIZE * (x + size * y)
+ *   end    in the record, the score zigzag encoded
+ *
+ * Every record starts with (payload << 2) | kind */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "core.h"
+
+/* "BLKP" and the version */
+#define REPLAY_MAGIC "BLKP\x01"
+#define REPLAY_MAGIC_SIZE 5
+
+/* playback keeps the game every this many moves, seeking plays at most this many */
+#define SNAPSHOT_INTERVAL 32
+
+typedef enum {
+  RECORD_DEAL,
+  RECORD_MOVE,
+  RECORD_END,
+  RECORD_GAME,
+  } RecordKind;
+
+typedef struct Recorder {
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+  
+  /* when set every record is written through to it and data only holds the one being written */
+  FILE *file;
+  
+  int board_size; /* of the game being recorded, moves are encoded with it */
+  } Recorder;
+
+typedef struct {
+  uint64_t seed;
+  int board_size;
+  bool fair_deal;
+  uint64_t rules_hash;
+  } ReplayHeader;
+
+typedef enum {
+  REPLAY_OK,
+  REPLAY_UNFINISHED,  /* it stops before the game is over, everything until there checks out */
+  REPLAY_ENDED_EARLY, /* it records the end while the game could still go on */
+  REPLAY_CORRUPT,     /* not a replay or cut off in the middle of a record */
+  REPLAY_WRONG_RULES, /* recorded with other rules or on a board these can't have */
+  REPLAY_BAD_DEAL,    /* a deal the seed doesn't give */
+  REPLAY_ILLEGAL_MOVE,
+  REPLAY_BAD_SCORE,   /* the recorded score isn't what the moves add up to */
+  NUM_REPLAY_STATUSES,
+  } ReplayStatus;
+
+extern const char *replay_status_names[NUM_REPLAY_STATUSES];
+
+typedef struct {
+  ReplayHeader header;
+  ReplayStatus status;
+  int score; /* what playing it again scored */
+  int num_moves;
+  } ReplayResult;
+
+/* the game every SNAPSHOT_INTERVAL moves of one replayed game, for seeking in it */
+typedef struct {
+  ReplayResult result;
+  
+  Move *moves;
+  int num_moves;
+  
+  Game *snapshots; /* snapshots[i] is the game after i * SNAPSHOT_INTERVAL moves */
+  int num_snapshots;
+  } Playback;
+
+/* recording, a game with a recorder calls these itself */
+void recorder_init(Recorder *recorder);
+bool recorder_open(Recorder *recorder, const char *path); /* writes REPLAY_MAGIC and streams into path */
+void recorder_close(Recorder *recorder);
+
+void record_game(Recorder *recorder, uint64_t seed, const Game *game);
+void record_deal(Recorder *recorder, const Shape *selection);
+void record_move(Recorder *recorder, Move move);
+void record_end(Recorder *recorder, int score);
+
+/* where every game of a replay file starts, past REPLAY_MAGIC. malloc'd, -1 when it isn't a replay */
+int replay_index(const uint8_t *data, size_t size, size_t **offsets);
+
+/* plays the game at offset again and checks it against the record */
+ReplayStatus replay_check(const uint8_t *data, size_t size, size_t offset, ReplayResult *result);
+
+bool playback_load(Playback *playback, const uint8_t *data, size_t size, size_t offset);
+void playback_free(Playback *playback);
+
+/* the game after the first move moves */
+void playback_seek(const Playback *playback, int move, Game *game);
+
+#endif
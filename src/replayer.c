@@ -0,0 +1,160 @@
+/* Replay checker
+ * plays every game of a replay file again on every core and reports the
+ * ones that don't check out, for auditing recorded scores in bulk */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "core.h"
+#include "rules.h"
+#include "replay.h"
+
+/* games handed out to a thread at a time */
+#define CHUNK_SIZE 256
+
+/* failing games printed before the rest are only counted */
+#define MAX_REPORTED 20
+
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  
+  size_t *offsets;
+  int num_games;
+  
+  atomic_int next_game;
+  
+  ReplayResult *results; /* indexed by game */
+  } Batch;
+
+void *worker(void *arg) {
+  Batch *batch = arg;
+  
+  while (1) {
+    int start = atomic_fetch_add(&batch->next_game, CHUNK_SIZE);
+    if (start >= batch->num_games) break;
+    
+    int end = start + CHUNK_SIZE;
+    if (end > batch->num_games) end = batch->num_games;
+    
+    for (int i=start; i<end; i ++)
+      replay_check(batch->data, batch->size, batch->offsets[i], &batch->results[i]);
+    }
+  
+  return NULL;
+  }
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+
+uint8_t *read_file(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return NULL;
+  
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  
+  uint8_t *data = malloc(*size ? *size : 1);
+  if (fread(data, 1, *size, file) != *size) {
+    free(data);
+    data = NULL;
+    }
+  
+  fclose(file);
+  return data;
+  }
+
+void usage(const char *program) {
+  printf("usage: %s [-t threads] [-r rules] replay file\n", program);
+  }
+
+int main(int argc, char **argv) {
+  int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *rules_path = NULL;
+  
+  int opt;
+  while ((opt = getopt(argc, argv, "t:r:h")) != -1) {
+    switch (opt) {
+      case 't': num_threads = atoi(optarg); break;
+      case 'r': rules_path = optarg; break;
+      default: usage(argv[0]); return opt != 'h';
+      }
+    }
+  
+  if (optind != argc - 1 || num_threads <= 0) {
+    usage(argv[0]);
+    return 1;
+    }
+  
+  const char *path = argv[optind];
+  
+  core_init();
+  if (rules_path && !rules_load(rules_path)) return 1;
+  
+  Batch batch = {0};
+  
+  batch.data = read_file(path, &batch.size);
+  if (!batch.data) {
+    printf("can't read %s\n", path);
+    return 1;
+    }
+  
+  batch.num_games = replay_index(batch.data, batch.size, &batch.offsets);
+  if (batch.num_games < 0) {
+    printf("%s isn't a replay file\n", path);
+    return 1;
+    }
+  
+  batch.results = malloc(sizeof(ReplayResult) * (batch.num_games ? batch.num_games : 1));
+  atomic_init(&batch.next_game, 0);
+  
+  pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+  
+  double start = now();
+  
+  for (int i=0; i<num_threads; i ++)
+    pthread_create(&threads[i], NULL, worker, &batch);
+  
+  for (int i=0; i<num_threads; i ++)
+    pthread_join(threads[i], NULL);
+  
+  double elapsed = now() - start;
+  
+  long long total_moves = 0;
+  int counts[NUM_REPLAY_STATUSES] = {0};
+  int reported = 0;
+  
+  for (int i=0; i<batch.num_games; i ++) {
+    ReplayResult *result = &batch.results[i];
+    
+    total_moves += result->num_moves;
+    counts[result->status] ++;
+    
+    if (result->status != REPLAY_OK && reported ++ < MAX_REPORTED)
+      printf("game %d: %s after %d moves, seed %llu\n", i, replay_status_names[result->status],
+        result->num_moves, (unsigned long long) result->header.seed);
+    }
+  
+  printf("%d games, %lld moves, %d threads, %zu bytes\n", batch.num_games, total_moves, num_threads, batch.size);
+  printf("%.3f s  %.0f games/s  %.0f moves/s\n", elapsed, batch.num_games / elapsed, total_moves / elapsed);
+  
+  for (int status=0; status<NUM_REPLAY_STATUSES; status ++) {
+    if (counts[status]) printf("%-12s %d\n", replay_status_names[status], counts[status]);
+    }
+  
+  free(threads);
+  free(batch.results);
+  free(batch.offsets);
+  free((void *) batch.data);
+  
+  return counts[REPLAY_OK] != batch.num_games;
+  }
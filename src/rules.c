@@ -0,0 +1,484 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#ifndef __EMSCRIPTEN__
+#include <sys/mman.h>
+#endif
+
+#include "rules.h"
+#include "shapes.h"
+
+/* the nanoseconds of a file's modification time, macOS names the field differently */
+#ifdef __APPLE__
+#define MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+const Rules *rules = NULL;
+
+static Rules builtin_rules;
+
+/* rules_hash of the rules in use, worked out whenever they change */
+static uint64_t current_hash;
+
+static uint64_t hash_rules(const Rules *compiled);
+
+/* rules_load's rules, mapped is set when they're the mapped cache and not malloc'd */
+static Rules *loaded = NULL;
+static bool loaded_mapped = false;
+
+/* ========== SHAPES ========== */
+
+static Shape shape_from_rows(const uint8_t rows[MAX_SHAPE_SIZE]) {
+  /* the footprint moved into the top left corner, with its size worked out */
+  Shape shape = {0};
+  uint8_t columns = 0;
+  int top = MAX_SHAPE_SIZE;
+  
+  for (int y=0; y<MAX_SHAPE_SIZE; y++) {
+    columns |= rows[y];
+    if (rows[y] && y < top) top = y;
+    }
+  
+  int left = __builtin_ctz(columns);
+  
+  for (int y=top; y<MAX_SHAPE_SIZE; y++) {
+    if (!rows[y]) continue;
+    
+    shape.rows[y - top] = rows[y] >> left;
+    shape.height = y - top + 1;
+    }
+  
+  shape.width = 32 - __builtin_clz(columns >> left);
+  
+  return shape;
+  }
+
+static Shape rotate_shape(Shape shape) {
+  /* a quarter turn clockwise, (x, y) goes to (height-1 - y, x) */
+  uint8_t rows[MAX_SHAPE_SIZE] = {0};
+  
+  for (int y=0; y<shape.height; y++) {
+    for (int x=0; x<shape.width; x++) {
+      if (shape.rows[y] & (1 << x)) rows[x] |= 1 << (shape.height - 1 - y);
+      }
+    }
+  
+  return shape_from_rows(rows);
+  }
+
+static Shape mirror_shape(Shape shape) {
+  uint8_t rows[MAX_SHAPE_SIZE] = {0};
+  
+  for (int y=0; y<shape.height; y++) {
+    for (int x=0; x<shape.width; x++) {
+      if (shape.rows[y] & (1 << x)) rows[y] |= 1 << (shape.width - 1 - x);
+      }
+    }
+  
+  return shape_from_rows(rows);
+  }
+
+static bool add_shape(Rules *compiled, Shape shape, unsigned int weight) {
+  /* shapes that are already there keep their first weight */
+  for (int i=0; i<compiled->num_shapes; i ++) {
+    Shape *other = &compiled->shapes[i];
+    
+    if (other->width == shape.width && other->height == shape.height
+     && !memcmp(other->rows, shape.rows, sizeof(shape.rows)))
+      return true;
+    }
+  
+  if (compiled->num_shapes == MAX_SHAPES) return false;
+  if (weight > MAX_SPAWN_WEIGHT - compiled->total_spawn_weight) return false;
+  
+  int id = compiled->num_shapes ++;
+  shape.template_id = id;
+  
+  for (int y=0; y<shape.height; y++) {
+    for (int x=0; x<shape.width; x++) {
+      if (shape.rows[y] & (1 << x)) compiled->cells[id][shape.num_cells ++] = (ShapeCell) {x, y};
+      }
+    }
+  
+  for (unsigned int i=0; i<weight; i ++)
+    compiled->spawn_table[compiled->total_spawn_weight ++] = id;
+  
+  compiled->shapes[id] = shape;
+  return true;
+  }
+
+static bool compile_shapes(Rules *compiled, const ShapeTemplate *templates, int num_templates) {
+  /* generate the orientations of every template, the rest of the game only sees the result.
+   * False when there are too many of them or their weights don't fit */
+  compiled->num_shapes = 0;
+  compiled->total_spawn_weight = 0;
+  
+  for (int i=0; i<num_templates; i ++) {
+    const ShapeTemplate *template = &templates[i];
+    Shape shape = shape_from_rows(template->rows);
+    
+    int rotations = template->orientations == ORIENT_FIXED ? 1 : 4;
+    int mirrors = template->orientations == ORIENT_ALL ? 2 : 1;
+    
+    for (int mirror=0; mirror<mirrors; mirror ++) {
+      for (int rotation=0; rotation<rotations; rotation ++) {
+        if (!add_shape(compiled, shape, template->weight)) return false;
+        shape = rotate_shape(shape);
+        }
+      
+      shape = mirror_shape(shape);
+      }
+    }
+  
+  return compiled->total_spawn_weight > 0;
+  }
+
+static void rules_defaults(Rules *compiled) {
+  memset(compiled, 0, sizeof(Rules));
+  
+  compiled->magic = RULES_MAGIC;
+  compiled->version = RULES_VERSION;
+  compiled->struct_size = sizeof(Rules);
+  
+  compiled->board_size = DEFAULT_BOARD_SIZE;
+  compiled->line_points = 1;
+  compiled->cross_bonus = 50;
+  }
+
+void rules_init() {
+  rules_defaults(&builtin_rules);
+  compile_shapes(&builtin_rules, shape_templates, NUM_SHAPE_TEMPLATES);
+  
+  rules = &builtin_rules;
+  current_hash = hash_rules(rules);
+  }
+
+/* ========== TEXT FILES ========== */
+
+static bool parse_error(const char *path, int line_number, const char *message) {
+  printf("rules: %s:%d: %s\n", path, line_number, message);
+  return false;
+  }
+
+static bool blank(const char *text) {
+  return !text[strspn(text, " \t\r\n")];
+  }
+
+bool rules_parse(Rules *compiled, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    printf("rules: can't open %s\n", path);
+    return false;
+    }
+  
+  static const char *orientation_names[] = {"fixed", "rotate", "all"};
+  
+  ShapeTemplate templates[MAX_SHAPES];
+  int num_templates = 0;
+  int shape_height = -1; /* rows of the footprint read so far, -1 outside a shape */
+  
+  char line[256];
+  int line_number = 0;
+  bool ok = true;
+  
+  rules_defaults(compiled);
+  
+  while (ok && fgets(line, sizeof(line), file)) {
+    line_number ++;
+    
+    char *start = line;
+    while (*start == ' ' || *start == '\t') start ++;
+    
+    /* everything up to the trailing whitespace */
+    int length = strcspn(start, "\r\n");
+    while (length && (start[length - 1] == ' ' || start[length - 1] == '\t')) length --;
+    
+    if (!*start || *start == '#' || !length) continue;
+    
+    /* a footprint row */
+    if (*start == 'X' || *start == '.') {
+      if (shape_height < 0) { ok = parse_error(path, line_number, "footprint row outside a shape"); break; }
+      if (shape_height == MAX_SHAPE_SIZE || length > MAX_SHAPE_SIZE) { ok = parse_error(path, line_number, "footprint is bigger than 5x5"); break; }
+      
+      uint8_t row = 0;
+      for (int x=0; x<length && ok; x++) {
+        if (start[x] == 'X') row |= 1 << x;
+        else if (start[x] != '.') ok = parse_error(path, line_number, "footprint rows are X and .");
+        }
+      
+      templates[num_templates - 1].rows[shape_height ++] = row;
+      continue;
+      }
+    
+    /* the shape before is done */
+    if (shape_height == 0) { ok = parse_error(path, line_number, "shape without a footprint"); break; }
+    shape_height = -1;
+    
+    char keyword[32], name[32];
+    int value, used = 0;
+    unsigned int weight;
+    
+    if (sscanf(start, "board_size %d%n", &value, &used) == 1) {
+      if (!board_size_valid(value)) { ok = parse_error(path, line_number, "board_size out of range"); break; }
+      compiled->board_size = value;
+      }
+    else if (sscanf(start, "line_points %d%n", &value, &used) == 1)
+      compiled->line_points = value;
+    else if (sscanf(start, "cross_bonus %d%n", &value, &used) == 1)
+      compiled->cross_bonus = value;
+    else if (sscanf(start, "shape %31s %u%n", name, &weight, &used) == 2) {
+      if (num_templates == MAX_SHAPES) { ok = parse_error(path, line_number, "too many shapes"); break; }
+      
+      ShapeTemplate *template = &templates[num_templates ++];
+      memset(template, 0, sizeof(ShapeTemplate));
+      template->weight = weight;
+      template->orientations = -1;
+      
+      for (int i=0; i<(int) (sizeof(orientation_names) / sizeof(orientation_names[0])); i ++) {
+        if (!strcmp(name, orientation_names[i])) template->orientations = i;
+        }
+      
+      if (template->orientations == (Orientations) -1) { ok = parse_error(path, line_number, "orientations are fixed, rotate or all"); break; }
+      shape_height = 0;
+      }
+    else {
+      sscanf(start, "%31s", keyword);
+      snprintf(line, sizeof(line), "unknown or incomplete line starting with %s", keyword);
+      ok = parse_error(path, line_number, line);
+      }
+    
+    if (ok && !blank(start + used)) {
+      sscanf(start, "%31s", keyword);
+      snprintf(line, sizeof(line), "unexpected text after %s", keyword);
+      ok = parse_error(path, line_number, line);
+      }
+    }
+  
+  fclose(file);
+  
+  if (!ok) return false;
+  if (shape_height == 0) return parse_error(path, line_number, "shape without a footprint");
+  
+  for (int i=0; i<num_templates; i ++) {
+    uint8_t blocks = 0;
+    for (int y=0; y<MAX_SHAPE_SIZE; y++) blocks |= templates[i].rows[y];
+    
+    if (!blocks) {
+      printf("rules: %s: shape %d has no blocks\n", path, i + 1);
+      return false;
+      }
+    }
+  
+  if (!compile_shapes(compiled, templates, num_templates)) {
+    printf("rules: %s: no shapes with weight, more than %d orientations or their weights add up to more than %d\n",
+      path, MAX_SHAPES, MAX_SPAWN_WEIGHT);
+    return false;
+    }
+  
+  return true;
+  }
+
+/* ========== CACHE ========== */
+
+static bool rules_valid(const Rules *compiled) {
+  /* a cache is read straight into the game, so everything that's used as an index is checked */
+  if (compiled->magic != RULES_MAGIC || compiled->version != RULES_VERSION || compiled->struct_size != sizeof(Rules)) return false;
+  
+  if (!board_size_valid(compiled->board_size)) return false;
+  if (compiled->num_shapes < 1 || compiled->num_shapes > MAX_SHAPES) return false;
+  if (compiled->total_spawn_weight < 1 || compiled->total_spawn_weight > MAX_SPAWN_WEIGHT) return false;
+  
+  for (unsigned int i=0; i<compiled->total_spawn_weight; i ++) {
+    if (compiled->spawn_table[i] >= compiled->num_shapes) return false;
+    }
+  
+  for (int i=0; i<compiled->num_shapes; i ++) {
+    const Shape *shape = &compiled->shapes[i];
+    
+    if (shape->width < 1 || shape->width > MAX_SHAPE_SIZE || shape->height < 1 || shape->height > MAX_SHAPE_SIZE) return false;
+    if (shape->template_id != i || shape->num_cells < 1 || shape->num_cells > MAX_SHAPE_CELLS) return false;
+    
+    for (int j=0; j<shape->num_cells; j ++) {
+      if (compiled->cells[i][j].x >= shape->width || compiled->cells[i][j].y >= shape->height) return false;
+      }
+    }
+  
+  return true;
+  }
+
+static Rules *map_rules(const char *path, bool *mapped) {
+  /* the compiled rules in path, NULL when it isn't a cache this build can use.
+   * The web build has no real files to map, it reads them in */
+  FILE *file = fopen(path, "rb");
+  if (!file) return NULL;
+  
+  struct stat info;
+  if (fstat(fileno(file), &info) || info.st_size != sizeof(Rules)) {
+    fclose(file);
+    return NULL;
+    }
+  
+  Rules *compiled = NULL;
+  
+  #ifdef __EMSCRIPTEN__
+  
+  compiled = malloc(sizeof(Rules));
+  if (fread(compiled, sizeof(Rules), 1, file) != 1) {
+    free(compiled);
+    compiled = NULL;
+    }
+  *mapped = false;
+  
+  #else
+  
+  void *memory = mmap(NULL, sizeof(Rules), PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  if (memory != MAP_FAILED) compiled = memory;
+  *mapped = true;
+  
+  #endif
+  
+  fclose(file);
+  
+  if (compiled && !rules_valid(compiled)) {
+    if (compiled->magic == RULES_MAGIC) printf("rules: %s is damaged or from another build, it isn't used\n", path);
+    
+    #ifdef __EMSCRIPTEN__
+    free(compiled);
+    #else
+    munmap(compiled, sizeof(Rules));
+    #endif
+    compiled = NULL;
+    }
+  
+  return compiled;
+  }
+
+static void release_rules(Rules *compiled, bool mapped) {
+  if (!compiled) return;
+  
+  #ifndef __EMSCRIPTEN__
+  if (mapped) {
+    munmap(compiled, sizeof(Rules));
+    return;
+    }
+  #endif
+  
+  free(compiled);
+  }
+
+static void write_cache(const Rules *compiled, const char *cache_path) {
+  /* written next to it and renamed, so a run that starts meanwhile never maps half a file */
+  char temp_path[PATH_MAX];
+  bool fits = snprintf(temp_path, sizeof(temp_path), "%s.tmp", cache_path) < (int) sizeof(temp_path);
+  
+  FILE *file = fits ? fopen(temp_path, "wb") : NULL;
+  if (!file) {
+    printf("rules: can't write %s, the rules will be parsed again next time\n", cache_path);
+    return;
+    }
+  
+  bool written = fwrite(compiled, sizeof(Rules), 1, file) == 1;
+  written = !fclose(file) && written;
+  
+  if (!written || rename(temp_path, cache_path)) {
+    printf("rules: can't write %s, the rules will be parsed again next time\n", cache_path);
+    remove(temp_path);
+    }
+  }
+
+static void use_rules(Rules *compiled, bool mapped) {
+  release_rules(loaded, loaded_mapped);
+  
+  loaded = compiled;
+  loaded_mapped = mapped;
+  rules = compiled;
+  current_hash = hash_rules(rules);
+  }
+
+bool rules_load(const char *path) {
+  struct stat source;
+  if (stat(path, &source)) {
+    printf("rules: can't open %s\n", path);
+    return false;
+    }
+  
+  bool mapped;
+  Rules *compiled = map_rules(path, &mapped);
+  
+  /* a compiled file on its own */
+  if (compiled) {
+    use_rules(compiled, mapped);
+    return true;
+    }
+  
+  /* a path too long to put .bin after is parsed every time */
+  char cache_path[PATH_MAX];
+  bool cacheable = snprintf(cache_path, sizeof(cache_path), "%s.bin", path) < (int) sizeof(cache_path);
+  
+  compiled = cacheable ? map_rules(cache_path, &mapped) : NULL;
+  
+  if (compiled
+   && compiled->source_size == source.st_size
+   && compiled->source_mtime_sec == source.st_mtime
+   && compiled->source_mtime_nsec == MTIME_NSEC(source)) {
+    use_rules(compiled, mapped);
+    return true;
+    }
+  
+  /* no cache, or it's out of date */
+  release_rules(compiled, mapped);
+  
+  compiled = malloc(sizeof(Rules));
+  if (!rules_parse(compiled, path)) {
+    free(compiled);
+    return false;
+    }
+  
+  compiled->source_size = source.st_size;
+  compiled->source_mtime_sec = source.st_mtime;
+  compiled->source_mtime_nsec = MTIME_NSEC(source);
+  
+  if (cacheable) write_cache(compiled, cache_path);
+  else printf("rules: %s is too long a path for a cache next to it, the rules will be parsed every time\n", path);
+  use_rules(compiled, false);
+  return true;
+  }
+
+/* ========== HASH ========== */
+
+static uint64_t hash_mix(uint64_t hash, uint64_t value) {
+  /* FNV-1a a whole value at a time */
+  return (hash ^ value) * 0x100000001B3ull;
+  }
+
+static uint64_t hash_rules(const Rules *compiled) {
+  /* Field by field, the struct's padding and where it was loaded from don't count.
+   * Neither does the board size, a replay has its own */
+  uint64_t hash = 0xCBF29CE484222325ull;
+  
+  hash = hash_mix(hash, compiled->line_points);
+  hash = hash_mix(hash, compiled->cross_bonus);
+  hash = hash_mix(hash, compiled->num_shapes);
+  
+  for (int i=0; i<compiled->num_shapes; i ++) {
+    const Shape *shape = &compiled->shapes[i];
+    
+    hash = hash_mix(hash, shape->width);
+    hash = hash_mix(hash, shape->height);
+    for (int y=0; y<MAX_SHAPE_SIZE; y++) hash = hash_mix(hash, shape->rows[y]);
+    }
+  
+  hash = hash_mix(hash, compiled->total_spawn_weight);
+  for (unsigned int i=0; i<compiled->total_spawn_weight; i ++) hash = hash_mix(hash, compiled->spawn_table[i]);
+  
+  return hash;
+  }
+
+uint64_t rules_hash() {
+  return current_hash;
+  }
@@ -0,0 +1,81 @@
+/* Rulesets
+ * the shapes, spawn weights, board size and scoring a game is played with.
+ * The built in rules come from shapes.h, others are loaded from a text file:
+ *
+ *   # a comment
+ *   board_size 8          cells per side, --board-size still wins over it
+ *   line_points 1         a cleared line scores board size * line_points
+ *   cross_bonus 50        clearing rows and columns at once adds this % of rows * columns
+ *   shape rotate 1        fixed, rotate or all orientations and the spawn weight of each,
+ *   XXX                   then the footprint, X is a block and . is empty
+ *   .X.
+ *
+ * A text file is compiled into path.bin next to it the first time it's loaded,
+ * after that the cache is only mapped into memory until the text file changes */
+
+#ifndef RULES_H
+#define RULES_H
+
+#include "core.h"
+
+#define RULES_MAGIC 0x524b4c42 /* "BLKR" */
+#define RULES_VERSION 1
+
+/* orientations after dedup, and the spawn weights of all of them together */
+#define MAX_SHAPES 128
+#define MAX_SPAWN_WEIGHT 4096
+
+typedef enum {
+  ORIENT_FIXED,   /* only dealt the way it's written */
+  ORIENT_ROTATE,  /* all 4 rotations */
+  ORIENT_ALL,     /* the rotations and their mirror images */
+  } Orientations;
+
+typedef struct {
+  uint8_t rows[MAX_SHAPE_SIZE];
+  Orientations orientations;
+  unsigned int weight; /* spawn weight of every orientation that's left after dedup */
+  } ShapeTemplate;
+
+/* The compiled rules, one block without pointers so the cache file is just this struct.
+ * A cache from another version or build doesn't match the magic, version or size */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t struct_size;
+  
+  /* the text file it was compiled from, the cache is rebuilt when it changes */
+  int64_t source_size;
+  int64_t source_mtime_sec;
+  int64_t source_mtime_nsec;
+  
+  int board_size;
+  int line_points;
+  int cross_bonus;
+  
+  int num_shapes;
+  Shape shapes[MAX_SHAPES]; /* template_id is the index */
+  ShapeCell cells[MAX_SHAPES][MAX_SHAPE_CELLS];
+  
+  /* one slot per unit of spawn weight, so a deal is a single lookup */
+  unsigned int total_spawn_weight;
+  uint16_t spawn_table[MAX_SPAWN_WEIGHT];
+  } Rules;
+
+/* the rules in use, never NULL after core_init */
+extern const Rules *rules;
+
+/* switches to the built in rules, called by core_init */
+void rules_init();
+
+/* parses a text file and generates the shapes, false with a message when it's broken */
+bool rules_parse(Rules *compiled, const char *path);
+
+/* switches to the rules in path, a text file or a compiled cache. Uses or
+ * rebuilds path.bin for a text file. Keeps the current rules when it fails */
+bool rules_load(const char *path);
+
+/* a hash of everything in the current rules that changes how a game plays, replays are checked against it */
+uint64_t rules_hash();
+
+#endif
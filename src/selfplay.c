@@ -0,0 +1,311 @@
+/* Self-play harness
+ * plays a batch of independent games on every core and reports throughput
+ * and the score / game length distributions */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "core.h"
+#include "solver.h"
+#include "lines.h"
+#include "rules.h"
+#include "replay.h"
+
+/* games handed out to a thread at a time */
+#define CHUNK_SIZE 64
+
+typedef enum {
+  POLICY_RANDOM,
+  POLICY_GREEDY,
+  POLICY_SOLVER,
+  } Policy;
+
+const char *policy_names[] = {"random", "greedy", "solver"};
+
+typedef struct {
+  int num_games;
+  Policy policy;
+  uint64_t seed;
+  uint64_t seed_key; /* the seed run through the generator once, game i is seeded with seed_key + i */
+  bool fair_deal;
+  int board_size;
+  
+  atomic_int next_game;
+  
+  /* results, indexed by game */
+  int *scores;
+  int *lengths;
+  int *unproven_deals; /* fair deals the search couldn't prove, see MAX_DEAL_NODES */
+  Recorder *replays; /* NULL unless the games are recorded */
+  } Batch;
+
+/* ========== POLICIES ========== */
+
+int greedy_move(Game *game, Move *moves, int num_moves, Random *rng) {
+  /* highest immediate score, ties broken by the emptiest board and then randomly.
+   * Only the occupancy is played out, the whole game is too big to copy for every move */
+  int size = game->board.occupied.size;
+  int best = 0, best_score = -1, best_filled = size * size + 1, num_best = 0;
+  
+  for (int i=0; i<num_moves; i ++) {
+    Move move = moves[i];
+    Bitboard next;
+    
+    int points = bitboard_play(&next, &game->board.occupied, &game->selection[move.shape], move.x, move.y);
+    int filled = bitboard_count(&next);
+    
+    if (points > best_score || (points == best_score && filled < best_filled)) {
+      best = i;
+      best_score = points;
+      best_filled = filled;
+      num_best = 1;
+      }
+    else if (points == best_score && filled == best_filled) {
+      /* reservoir sampling over the tied moves */
+      num_best ++;
+      if (random_below(rng, num_best) == 0) best = i;
+      }
+    }
+  
+  return best;
+  }
+
+int solver_move(Game *game, Move *moves, int num_moves, Solver *solver) {
+  /* play the first move of the best line for the pieces left */
+  Solution solution;
+  solve(solver, &game->board, game->selection, &solution);
+  
+  for (int i=0; i<num_moves; i ++) {
+    if (!memcmp(&moves[i], &solution.moves[0], sizeof(Move))) return i;
+    }
+  
+  return 0;
+  }
+
+void play_game(Batch *batch, Solver *solver, int index) {
+  Game game;
+  Move moves[MAX_MOVES];
+  
+  /* every game gets its own seed so the results don't depend on the thread count.
+   * It comes from the mixed seed, -s 1 and -s 2 would share games otherwise */
+  Random rng;
+  random_seed(&rng, batch->seed_key + index);
+  game.fair_deal = batch->fair_deal;
+  game.board_size = batch->board_size;
+  game.recorder = batch->replays ? &batch->replays[index] : NULL;
+  new_game(&game, random_next(&rng));
+  
+  int length = 0;
+  while (!is_over(&game)) {
+    int num_moves = legal_moves(&game, moves);
+    int move;
+    
+    if (batch->policy == POLICY_GREEDY)
+      move = greedy_move(&game, moves, num_moves, &rng);
+    else if (batch->policy == POLICY_SOLVER)
+      move = solver_move(&game, moves, num_moves, solver);
+    else
+      move = random_below(&rng, num_moves);
+    
+    apply_move(&game, moves[move]);
+    length ++;
+    }
+  
+  batch->scores[index] = score(&game);
+  batch->lengths[index] = length;
+  batch->unproven_deals[index] = game.unproven_deals;
+  }
+
+void *worker(void *arg) {
+  Batch *batch = arg;
+  Solver *solver = batch->policy == POLICY_SOLVER ? solver_create(OBJECTIVE_HEURISTIC) : NULL;
+  
+  while (1) {
+    int start = atomic_fetch_add(&batch->next_game, CHUNK_SIZE);
+    if (start >= batch->num_games) break;
+    
+    int end = start + CHUNK_SIZE;
+    if (end > batch->num_games) end = batch->num_games;
+    
+    for (int i=start; i<end; i ++)
+      play_game(batch, solver, i);
+    }
+  
+  if (solver) solver_destroy(solver);
+  
+  return NULL;
+  }
+
+/* ========== REPORT ========== */
+
+int compare_ints(const void *a, const void *b) {
+  int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+  }
+
+void print_distribution(const char *name, int *values, int count) {
+  long long sum = 0;
+  for (int i=0; i<count; i ++) sum += values[i];
+  
+  qsort(values, count, sizeof(int), compare_ints);
+  
+  printf("%-8s mean %10.2f  min %7d  p10 %7d  p50 %7d  p90 %7d  p99 %7d  max %7d\n",
+    name, (double) sum / count,
+    values[0],
+    values[count / 10],
+    values[count / 2],
+    values[count * 9 / 10],
+    values[count * 99 / 100],
+    values[count - 1]);
+  }
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+
+void usage(const char *program) {
+  printf("usage: %s [-n games] [-t threads] [-p random|greedy|solver] [-s seed] [-b board size] [-r rules] [-k avx2|sse2|scalar] [-w replay file] [-f]\n", program);
+  }
+
+int main(int argc, char **argv) {
+  int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  
+  Batch batch = {0};
+  batch.num_games = 100000;
+  batch.policy = POLICY_RANDOM;
+  batch.seed = 1;
+  
+  /* NULL keeps the ones core_init picks */
+  const char *kernels = NULL;
+  const char *rules_path = NULL;
+  const char *replay_path = NULL;
+  
+  int opt;
+  while ((opt = getopt(argc, argv, "n:t:p:s:b:r:k:w:fh")) != -1) {
+    switch (opt) {
+      case 'n': batch.num_games = atoi(optarg); break;
+      case 't': num_threads = atoi(optarg); break;
+      case 's': batch.seed = strtoull(optarg, NULL, 0); break;
+      case 'b': batch.board_size = atoi(optarg); break;
+      case 'r': rules_path = optarg; break;
+      case 'k': kernels = optarg; break;
+      case 'w': replay_path = optarg; break;
+      case 'f': batch.fair_deal = true; break;
+      case 'p':
+        batch.policy = -1;
+        for (int i=0; i<(int) (sizeof(policy_names) / sizeof(policy_names[0])); i ++) {
+          if (!strcmp(optarg, policy_names[i])) batch.policy = i;
+          }
+        if (batch.policy == (Policy) -1) { usage(argv[0]); return 1; }
+        break;
+      default: usage(argv[0]); return opt != 'h';
+      }
+    }
+  
+  if (batch.num_games <= 0 || num_threads <= 0) {
+    usage(argv[0]);
+    return 1;
+    }
+  
+  core_init();
+  
+  if (rules_path && !rules_load(rules_path)) return 1;
+  
+  /* the ruleset's board unless -b says otherwise */
+  if (!batch.board_size) batch.board_size = rules->board_size;
+  
+  if (!board_size_valid(batch.board_size)) {
+    usage(argv[0]);
+    return 1;
+    }
+  
+  if (kernels && !lines_use(kernels)) {
+    printf("no %s line kernels on this machine\n", kernels);
+    return 1;
+    }
+  
+  Random seeder;
+  random_seed(&seeder, batch.seed);
+  batch.seed_key = random_next(&seeder);
+  
+  batch.scores = malloc(sizeof(int) * batch.num_games);
+  batch.lengths = malloc(sizeof(int) * batch.num_games);
+  batch.unproven_deals = malloc(sizeof(int) * batch.num_games);
+  
+  /* every game is recorded into its own buffer, they're written in order at the end */
+  if (replay_path) {
+    batch.replays = malloc(sizeof(Recorder) * batch.num_games);
+    for (int i=0; i<batch.num_games; i ++) recorder_init(&batch.replays[i]);
+    }
+  atomic_init(&batch.next_game, 0);
+  
+  pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+  
+  double start = now();
+  
+  for (int i=0; i<num_threads; i ++)
+    pthread_create(&threads[i], NULL, worker, &batch);
+  
+  for (int i=0; i<num_threads; i ++)
+    pthread_join(threads[i], NULL);
+  
+  double elapsed = now() - start;
+  
+  long long total_moves = 0;
+  for (int i=0; i<batch.num_games; i ++) total_moves += batch.lengths[i];
+  
+  printf("%d games, %lld moves, %d threads, %s policy, %dx%d, seed %llu%s%s%s\n",
+    batch.num_games, total_moves, num_threads,
+    policy_names[batch.policy],
+    batch.board_size, batch.board_size,
+    (unsigned long long) batch.seed,
+    batch.fair_deal ? ", fair deal" : "",
+    rules_path ? ", rules " : "", rules_path ? rules_path : "");
+  printf("%.3f s  %.0f games/s  %.0f moves/s  %s line kernels\n", elapsed, batch.num_games / elapsed, total_moves / elapsed, line_kernels.name);
+  
+  print_distribution("score", batch.scores, batch.num_games);
+  print_distribution("length", batch.lengths, batch.num_games);
+  
+  if (batch.fair_deal) {
+    /* the fair deal is only a guarantee when this is 0 */
+    long long unproven = 0;
+    for (int i=0; i<batch.num_games; i ++) unproven += batch.unproven_deals[i];
+    
+    printf("unproven %lld deals went out without being proven to fit\n", unproven);
+    }
+  
+  if (replay_path) {
+    FILE *file = fopen(replay_path, "wb");
+    size_t replay_size = REPLAY_MAGIC_SIZE;
+    
+    if (file) fwrite(REPLAY_MAGIC, 1, REPLAY_MAGIC_SIZE, file);
+    else printf("can't open %s\n", replay_path);
+    
+    for (int i=0; i<batch.num_games; i ++) {
+      if (file) fwrite(batch.replays[i].data, 1, batch.replays[i].size, file);
+      replay_size += batch.replays[i].size;
+      recorder_close(&batch.replays[i]);
+      }
+    
+    if (file) {
+      fclose(file);
+      printf("replays  %zu bytes, %.2f bytes a move\n", replay_size, (double) replay_size / total_moves);
+      }
+    
+    free(batch.replays);
+    }
+  
+  free(threads);
+  free(batch.scores);
+  free(batch.lengths);
+  free(batch.unproven_deals);
+  
+  return 0;
+  }
@@ -1,156 +1,43 @@
-/* Shapes */
+/* Shape templates
+ * the built in shape set, only included by rules.c.
+ * Every template is one footprint, rules_init turns it into its orientations
+ * and drops the ones that came out the same */
 
-typedef struct {
-  unsigned int width;
-  unsigned int height;
-  unsigned int color;
-  char *data;
-  } Shape;
+/* a footprint row written left to right, R(0b11000) is the 2 leftmost blocks */
+#define R(bits) ((((bits) >> 4) & 1) | (((bits) >> 2) & 2) | ((bits) & 4) | (((bits) << 2) & 8) | (((bits) << 4) & 16))
 
-const Shape shape_templates[] = {
-  (Shape) {
-    2, 2,
-    0,
-    "1111",
-    },
-  (Shape) {
-    3, 2,
-    0,
-    "111111",
-    },
-  (Shape) {
-    2, 3,
-    0,
-    "111111",
-    },
-  (Shape) {
-    3, 3,
-    0,
-    "111111111",
-    },
-  (Shape) {
-    3, 2,
-    0,
-    "100"
-    "111",
-    },
-  (Shape) {
-    2, 2,
-    0,
-    "11"
-    "01",
-    },
-  (Shape) {
-    2, 2,
-    0,
-    "11"
-    "10",
-    },
-  (Shape) {
-    2, 2,
-    0,
-    "01"
-    "11",
-    },
-  (Shape) {
-    2, 2,
-    0,
-    "10"
-    "11",
-    },
-  (Shape) {
-    3, 3,
-    0,
-    "111"
-    "100"
-    "100",
-    },
-  (Shape) {
-    3, 3,
-    0,
-    "111"
-    "001"
-    "001",
-    },
-  (Shape) {
-    3, 3,
-    0,
-    "001"
-    "001"
-    "111",
-    },
-  (Shape) {
-    3, 3,
-    0,
-    "100"
-    "100"
-    "111",
-    },
-  (Shape) {
-    2, 1,
-    0,
-    "11",
-    },
-  (Shape) {
-    1, 2,
-    0,
-    "11",
-    },
-  (Shape) {
-    3, 1,
-    0,
-    "111",
-    },
-  (Shape) {
-    1, 3,
-    0,
-    "111",
-    },
-  (Shape) {
-    4, 1,
-    0,
-    "1111",
-    },
-  (Shape) {
-    1, 4,
-    0,
-    "1111",
-    },
-  (Shape) {
-    1, 1,
-    0,
-    "1",
-    },
-  (Shape) {
-    3, 2,
-    0,
-    "111010",
-    },
-  (Shape) {
-    3, 2,
-    0,
-    "010111",
-    },
-  (Shape) {
-    2, 3,
-    0,
-    "011101",
-    },
-  (Shape) {
-    2, 3,
-    0,
-    "101110",
-    },
-  (Shape) {
-    1, 4,
-    0,
-    "1111",
-    },
-  (Shape) {
-    4, 1,
-    0,
-    "1111",
-    },
+const ShapeTemplate shape_templates[] = {
+  /* squares and rectangles */
+  {{R(0b11000),
+    R(0b11000)}, ORIENT_FIXED, 1},
+  {{R(0b11100),
+    R(0b11100)}, ORIENT_ROTATE, 1},
+  {{R(0b11100),
+    R(0b11100),
+    R(0b11100)}, ORIENT_FIXED, 1},
+  
+  /* bars */
+  {{R(0b10000)}, ORIENT_FIXED, 1},
+  {{R(0b11000)}, ORIENT_ROTATE, 1},
+  {{R(0b11100)}, ORIENT_ROTATE, 1},
+  {{R(0b11110)}, ORIENT_ROTATE, 1},
+  
+  /* corners */
+  {{R(0b11000),
+    R(0b01000)}, ORIENT_ROTATE, 1},
+  {{R(0b11100),
+    R(0b10000),
+    R(0b10000)}, ORIENT_ROTATE, 1},
+  
+  /* the L is only ever dealt this way up */
+  {{R(0b10000),
+    R(0b11100)}, ORIENT_FIXED, 1},
+  
+  /* T */
+  {{R(0b11100),
+    R(0b01000)}, ORIENT_ROTATE, 1},
   };
 
-const int NUM_TEMPLATES = sizeof(shape_templates) / sizeof(shape_templates[0]);
+#undef R
+
+#define NUM_SHAPE_TEMPLATES ((int) (sizeof(shape_templates) / sizeof(shape_templates[0])))
@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "solver.h"
+
+#define TABLE_BITS 16
+#define TABLE_SIZE (1 << TABLE_BITS)
+
+/* how many nodes are searched between should_stop calls */
+#define STOP_CHECK_INTERVAL 1024
+
+/* how much worse an empty cell with no empty neighbours is than a filled one */
+#define ISOLATED_CELL_PENALTY 4
+
+Solver *solver_create(Objective objective) {
+  Solver *solver = malloc(sizeof(Solver));
+  
+  solver->objective = objective;
+  solver->table = calloc(TABLE_SIZE, sizeof(TableEntry));
+  solver->generation = 0;
+  solver->nodes = 0;
+  solver->should_stop = NULL;
+  solver->stop_data = NULL;
+  solver->stopped = false;
+  solver->max_nodes = 0;
+  solver->truncated = false;
+  
+  return solver;
+  }
+
+void solver_destroy(Solver *solver) {
+  free(solver->table);
+  free(solver);
+  }
+
+static int evaluate_packed(Solver *solver, uint64_t packed) {
+  /* evaluate_board for boards that fit into one word, packed like bitboard_key */
+  uint64_t empty = ~packed & solver->packed_mask;
+  uint64_t neighbours = ((empty << 1) & ~solver->packed_left)
+                      | ((empty >> 1) & ~solver->packed_right)
+                      | (empty << solver->size)
+                      | (empty >> solver->size);
+  
+  uint64_t isolated = empty & ~neighbours;
+  
+  return __builtin_popcountll(empty) - ISOLATED_CELL_PENALTY * __builtin_popcountll(isolated);
+  }
+
+static int evaluate_board(const Bitboard *occupied) {
+  /* Free space is good, single holes only the 1x1 piece can fill are bad.
+   * Rows are packed next to each other before they're counted, so a 16x16
+   * board takes four popcounts instead of sixteen */
+  int size = occupied->size;
+  Row full_row = ROW_MASK(size);
+  int empty_cells = 0, isolated_cells = 0;
+  
+  Row packed_empty = 0, packed_isolated = 0;
+  int shift = 0;
+  
+  for (int y=0; y<size; y++) {
+    Row empty = ~occupied->rows[y] & full_row;
+    Row neighbours = (empty << 1) | (empty >> 1);
+    
+    if (y > 0) neighbours |= ~occupied->rows[y-1];
+    if (y < size - 1) neighbours |= ~occupied->rows[y+1];
+    
+    if (shift + size > 64) {
+      empty_cells += __builtin_popcountll(packed_empty);
+      isolated_cells += __builtin_popcountll(packed_isolated);
+      packed_empty = packed_isolated = 0;
+      shift = 0;
+      }
+    
+    packed_empty |= empty << shift;
+    packed_isolated |= (empty & ~neighbours) << shift;
+    shift += size;
+    }
+  
+  empty_cells += __builtin_popcountll(packed_empty);
+  isolated_cells += __builtin_popcountll(packed_isolated);
+  
+  return empty_cells - ISOLATED_CELL_PENALTY * isolated_cells;
+  }
+
+static uint32_t table_index(uint64_t key, uint8_t remaining) {
+  uint64_t hash = (key ^ ((uint64_t) remaining << 59)) * 0x9E3779B97F4A7C15ull;
+  return hash >> (64 - TABLE_BITS);
+  }
+
+static bool is_better(Solution *a, Solution *b) {
+  /* placing more pieces always wins, a piece that doesn't fit ends the game */
+  if (a->num_moves != b->num_moves) return a->num_moves > b->num_moves;
+  return a->value > b->value;
+  }
+
+static void search(Solver *solver, Shape *selection, const Bitboard *occupied, uint8_t remaining, Solution *best) {
+  solver->nodes ++;
+  
+  if (solver->should_stop && solver->nodes % STOP_CHECK_INTERVAL == 0 && solver->should_stop(solver->stop_data))
+    solver->stopped = true;
+  
+  if (solver->max_nodes && solver->nodes >= solver->max_nodes)
+    solver->truncated = true;
+  
+  uint64_t key = bitboard_key(occupied);
+  
+  best->num_moves = 0;
+  best->score = 0;
+  best->value = 0;
+  
+  if (solver->objective == OBJECTIVE_HEURISTIC)
+    best->value = solver->packed_mask ? evaluate_packed(solver, key) : evaluate_board(occupied);
+  
+  if (!remaining || solver->stopped || solver->truncated) return;
+  
+  /* Different orderings often reach the same board with the same pieces left */
+  TableEntry *entry = &solver->table[table_index(key, remaining)];
+  if (entry->generation == solver->generation && entry->key == key && entry->remaining == remaining) {
+    *best = entry->solution;
+    return;
+    }
+  
+  /* Pieces that fit nowhere don't cut a branch off early: a clear can make room for them
+   * again and placing more pieces always wins, so only a branch that can't clear any line
+   * could go. A selection has enough cells to finish nearly any line of a board up to
+   * 16x16, so that never comes up. The table and skipping identical pieces do the work */
+  Solution child, line;
+  
+  for (int i=0; i<SELECTION_SIZE; i ++) {
+    if (!(remaining & (1 << i))) continue;
+    
+    /* identical pieces are interchangeable, only search the first one */
+    bool duplicate = false;
+    for (int j=0; j<i; j ++) {
+      if ((remaining & (1 << j)) && selection[j].template_id == selection[i].template_id) duplicate = true;
+      }
+    if (duplicate) continue;
+    
+    Shape shape = selection[i];
+    
+    for (int block_y=0; block_y + shape.height <= occupied->size; block_y ++) {
+      int block_x;
+      
+      FOR_EACH_BIT(block_x, fitting_columns(occupied, &shape, block_y)) {
+        Bitboard next;
+        int points = bitboard_play(&next, occupied, &shape, block_x, block_y);
+        
+        search(solver, selection, &next, remaining & ~(1 << i), &child);
+        
+        line.moves[0] = (Move) {i, block_x, block_y};
+        memcpy(line.moves + 1, child.moves, sizeof(Move) * child.num_moves);
+        line.num_moves = child.num_moves + 1;
+        line.score = child.score + points;
+        line.value = child.value + points;
+        
+        if (is_better(&line, best)) *best = line;
+        }
+      }
+    }
+  
+  /* a stopped or truncated search only looked at part of the tree */
+  if (solver->stopped || solver->truncated) return;
+  
+  *entry = (TableEntry) {key, solver->generation, remaining, *best};
+  }
+
+bool solve(Solver *solver, Board *board, Shape *selection, Solution *solution) {
+  uint8_t remaining = 0;
+  for (int i=0; i<SELECTION_SIZE; i ++) {
+    if (selection[i].color) remaining |= 1 << i;
+    }
+  
+  solver->generation ++;
+  solver->nodes = 0;
+  solver->stopped = false;
+  solver->truncated = false;
+  
+  /* small boards are evaluated from their key, which holds the whole board */
+  int size = board->occupied.size;
+  solver->size = size;
+  solver->packed_mask = solver->packed_left = solver->packed_right = 0;
+  
+  if (size * size <= 64) {
+    solver->packed_mask = ~(uint64_t) 0 >> (64 - size * size);
+    
+    for (int y=0; y<size; y++) {
+      solver->packed_left |= (uint64_t) 1 << (y * size);
+      solver->packed_right |= (uint64_t) 1 << (y * size + size - 1);
+      }
+    }
+  
+  search(solver, selection, &board->occupied, remaining, solution);
+  
+  return !solver->stopped && solution->num_moves > 0;
+  }
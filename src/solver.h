@@ -0,0 +1,60 @@
+/* Solver
+ * searches every ordering and placement of the pieces left in a selection
+ * and returns the best line, used for hints and for grading selections */
+
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include "core.h"
+
+typedef enum {
+  OBJECTIVE_SCORE,     /* only the points the line scores */
+  OBJECTIVE_HEURISTIC, /* the points plus how open the board is afterwards */
+  } Objective;
+
+typedef struct {
+  Move moves[SELECTION_SIZE];
+  int num_moves; /* less than the number of pieces left when they don't all fit */
+  int score;     /* points scored by the moves */
+  int value;     /* what the objective maximized */
+  } Solution;
+
+typedef struct {
+  uint64_t key; /* bitboard_key of the board, exact up to 8x8 */
+  uint32_t generation;
+  uint8_t remaining; /* bitmask of the selection indices still to be placed */
+  Solution solution;
+  } TableEntry;
+
+typedef struct {
+  Objective objective;
+  
+  TableEntry *table;
+  uint32_t generation; /* bumped every solve, so the table never has to be cleared */
+  
+  long nodes;
+  
+  /* the board being solved, the masks are only set when it fits into one word */
+  int size;
+  uint64_t packed_mask;
+  uint64_t packed_left, packed_right; /* the first and last column */
+  
+  /* optional, polled during the search which gives up once it returns true */
+  bool (*should_stop)(void *data);
+  void *stop_data;
+  bool stopped;
+  
+  /* 0 for no limit, past this many nodes the search gives up and returns
+   * the best line it found so far instead of the best one */
+  long max_nodes;
+  bool truncated; /* the last solve hit max_nodes */
+  } Solver;
+
+Solver *solver_create(Objective objective);
+void solver_destroy(Solver *solver);
+
+/* returns false when none of the pieces can be placed or the search was stopped,
+ * a truncated search still returns its line */
+bool solve(Solver *solver, Board *board, Shape *selection, Solution *solution);
+
+#endif
@@ -0,0 +1,33 @@
+/* Sprites
+ * everything the game draws from res/, packed into the atlas at build time
+ * by pack_res, see pack_res.c */
+
+#ifndef SPRITES_H
+#define SPRITES_H
+
+#define NUM_TEXTURES 16
+
+#define TEXTURE_BLOCK            0
+#define TEXTURE_BLOCK_EMPTY      1
+#define TEXTURE_RESTART          2
+#define TEXTURE_7SEGMENT_0       3
+#define TEXTURE_7SEGMENT_1       4
+#define TEXTURE_7SEGMENT_2       5
+#define TEXTURE_7SEGMENT_3       6
+#define TEXTURE_7SEGMENT_4       7
+#define TEXTURE_7SEGMENT_5       8
+#define TEXTURE_7SEGMENT_6       9
+#define TEXTURE_7SEGMENT_7       10
+#define TEXTURE_7SEGMENT_8       11
+#define TEXTURE_7SEGMENT_9       12
+#define TEXTURE_7SEGMENT_BG      13
+#define TEXTURE_7SEGMENT_MINUS   14
+#define TEXTURE_BLOCK_SPRITES    15 /* blank, the finished blocks are composed into it */
+
+#define BLOCK_SIZE_PX 32
+
+/* every color as a block, hover variants in the second row */
+#define BLOCK_SPRITES_WIDTH  (NUM_COLORS * BLOCK_SIZE_PX)
+#define BLOCK_SPRITES_HEIGHT (2 * BLOCK_SIZE_PX)
+
+#endif
@@ -0,0 +1,80 @@
+#ifdef BLOCKS_TRACE
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+
+#include "trace.h"
+
+/* events past this are dropped instead of growing the buffer mid frame */
+#define TRACE_CAPACITY (1 << 20)
+
+#define TRACE_DEFAULT_FILE "blocks_trace.json"
+
+typedef struct {
+  const char *name;
+  uint64_t timestamp;
+  SDL_threadID thread;
+  char phase;
+  } TraceEvent;
+
+static TraceEvent *trace_events;
+static SDL_atomic_t trace_count;
+static uint64_t trace_start;
+
+void trace_event(const char *name, char phase) {
+  if (!trace_events) {
+    /* the first event comes from init, before any other thread exists */
+    trace_events = malloc(sizeof(TraceEvent) * TRACE_CAPACITY);
+    trace_start = SDL_GetPerformanceCounter();
+    }
+  
+  int index = SDL_AtomicAdd(&trace_count, 1);
+  if (index >= TRACE_CAPACITY) return;
+  
+  trace_events[index] = (TraceEvent) {name, SDL_GetPerformanceCounter(), SDL_ThreadID(), phase};
+  }
+
+void trace_flush() {
+  if (!trace_events) return;
+  
+  const char *path = getenv("BLOCKS_TRACE_FILE");
+  if (!path || !*path) path = TRACE_DEFAULT_FILE;
+  
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    printf("trace: can't open %s\n", path);
+    return;
+    }
+  
+  int count = SDL_AtomicGet(&trace_count);
+  if (count > TRACE_CAPACITY) {
+    printf("trace: buffer full, dropped %d events\n", count - TRACE_CAPACITY);
+    count = TRACE_CAPACITY;
+    }
+  
+  double us_per_tick = 1e6 / (double) SDL_GetPerformanceFrequency();
+  
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  
+  for (int i=0; i<count; i ++) {
+    TraceEvent *event = &trace_events[i];
+    fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%lu}\n",
+      i ? "," : "",
+      event->name, event->phase,
+      (double) (event->timestamp - trace_start) * us_per_tick,
+      (unsigned long) event->thread);
+    }
+  
+  fprintf(file, "]}\n");
+  fclose(file);
+  
+  printf("trace: wrote %d events to %s\n", count, path);
+  
+  free(trace_events);
+  trace_events = NULL;
+  SDL_AtomicSet(&trace_count, 0);
+  }
+
+#endif
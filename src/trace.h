@@ -0,0 +1,27 @@
+/* Tracing
+ * begin/end events in the Chrome trace format (chrome://tracing, ui.perfetto.dev).
+ * Only compiled in with -DBLOCKS_TRACE ('make trace_build'), otherwise every
+ * macro expands to nothing. Events are buffered in memory and written on exit */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef BLOCKS_TRACE
+
+/* names must be string literals, only the pointer is stored */
+void trace_event(const char *name, char phase);
+void trace_flush();
+
+#define TRACE_BEGIN(name) trace_event(name, 'B')
+#define TRACE_END(name) trace_event(name, 'E')
+#define TRACE_FLUSH() trace_flush()
+
+#else
+
+#define TRACE_BEGIN(name) ((void) 0)
+#define TRACE_END(name) ((void) 0)
+#define TRACE_FLUSH() ((void) 0)
+
+#endif
+
+#endif